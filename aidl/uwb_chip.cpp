@@ -101,9 +101,8 @@ void onServiceDied(void *cookie) {
 ::ndk::ScopedAStatus UwbChip::sendUciMessage(const std::vector<uint8_t>&  data,
                                              int32_t* _aidl_return /* bytes_written */) {
     // TODO(b/195992658): Need emulator support for UCI stack.
-     std::vector<uint8_t> copy = data;
      LOG(INFO) << "AIDL-Write Enter";
-     int32_t ret = phNxpUciHal_write(data.size(), &copy[0]);
+     int32_t ret = phNxpUciHal_write(data.size(), data.data());
      *_aidl_return = ret;
      return ndk::ScopedAStatus::ok();
 }
@@ -56,7 +56,10 @@ class UwbChip : public BnUwbChip {
     }
   }
   static void dataCallback(uint16_t data_len, uint8_t* p_data) {
-      std::vector<uint8_t> data;
+      // The AIDL callback takes a vector, keep its storage across packets
+      // so that delivery does not allocate once it has grown to the
+      // largest packet size.
+      static thread_local std::vector<uint8_t> data;
       data.assign(p_data, p_data + data_len);
       if (mClientCallback != nullptr) {
           auto ret = mClientCallback->onUciMessage(data);
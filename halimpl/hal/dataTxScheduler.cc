@@ -0,0 +1,359 @@
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "dataTxScheduler.h"
+#include "phNxpConfig.h"
+#include "phNxpUciHal.h"
+#include "phNxpUciHal_cmd.h"
+#include "phNxpUciHal_utils.h"
+
+//
+// DataTxScheduler
+//
+// Credit based flow control of UCI DATA_MESSAGE_SND packets.
+//
+// The UWBS accepts one data packet per session credit: the credit is consumed
+// by each DATA_MESSAGE_SND and given back with SESSION_DATA_CREDIT_NTF.
+// Without the scheduler the upper layer has to pace itself and every data
+// packet blocks its caller in phNxpUciHal_write().
+//
+// With UWB_DATA_TX_SCHEDULER=1, data packets are queued per session and the
+// caller returns immediately. A session with a credit and queued packets is
+// put on a ready list, which is served round-robin one packet per turn so
+// that sessions are interleaved fairly. Packets are released through the
+// asynchronous command engine (phNxpUciHal_write_data_async()).
+//
+// A segmented message (PBF=1) is queued as one unit: the continuation
+// segments carry no session handle and belong to the message of the last
+// head segment. The message waits until its last segment is queued, then
+// all its segments are released back to back for one credit.
+//
+// Credit and transmit status notifications are still reported to upper layer.
+//
+class DataTxScheduler {
+private:
+  static constexpr uint8_t kOidDataCreditNtf = 0x04;
+  static constexpr uint8_t kOidDataTransmitStatusNtf = 0x05;
+  static constexpr size_t kHandleOffset = UCI_MSG_HDR_SIZE;
+  static constexpr size_t kCreditAvailOffset = UCI_MSG_HDR_SIZE + 4;
+  static constexpr size_t kTxStatusOffset = UCI_MSG_HDR_SIZE + 4 + 2;
+  static constexpr uint8_t kTxStatusOk = 0x00;
+  static constexpr uint8_t kTxStatusRepetitionOk = 0x01;
+  static constexpr unsigned long kQueueDepthDefault = 16;
+
+  using Clock = std::chrono::steady_clock;
+
+  struct DataTxMessage {
+    std::vector<std::vector<uint8_t>> segments_;
+    Clock::time_point queued_at_;
+    bool complete_;           // Last segment (PBF=0) queued
+  };
+  struct SessionQueue {
+    std::deque<DataTxMessage> messages_;
+    bool credit_ = true;      // UWBS starts with a credit available
+    bool ready_ = false;      // On ready_sessions_
+  };
+
+  std::mutex lock_;
+  std::unordered_map<uint32_t, SessionQueue> sessions_;
+  std::deque<uint32_t> ready_sessions_;
+  bool segmenting_ = false;   // Continuation segments go to segmenting_handle_
+  bool segmenting_dropped_ = false;
+  uint32_t segmenting_handle_ = 0;
+  unsigned long queue_depth_;
+  DataTxScheduler_Stats stats_;
+
+  UciHalRxHandler credit_ntf_handler_;
+  UciHalRxHandler tx_status_ntf_handler_;
+  UciHalRxHandler session_status_ntf_handler_;
+
+public:
+  DataTxScheduler() : queue_depth_(kQueueDepthDefault), stats_{} {
+    NxpConfig_GetNum(NAME_UWB_DATA_TX_QUEUE_DEPTH, &queue_depth_, sizeof(queue_depth_));
+    if (!queue_depth_) {
+      queue_depth_ = kQueueDepthDefault;
+    }
+
+    credit_ntf_handler_ = UciHalRxHandler(UCI_MT_NTF, UCI_GID_SESSION_CONTROL, kOidDataCreditNtf,
+      false, std::bind(&DataTxScheduler::OnDataCreditNtf, this,
+                       std::placeholders::_1, std::placeholders::_2));
+    tx_status_ntf_handler_ = UciHalRxHandler(UCI_MT_NTF, UCI_GID_SESSION_CONTROL, kOidDataTransmitStatusNtf,
+      false, std::bind(&DataTxScheduler::OnDataTransmitStatusNtf, this,
+                       std::placeholders::_1, std::placeholders::_2));
+    session_status_ntf_handler_ = UciHalRxHandler(UCI_MT_NTF, UCI_GID_SESSION_MANAGE, UCI_MSG_SESSION_STATUS_NTF,
+      false, std::bind(&DataTxScheduler::OnSessionStatusNtf, this,
+                       std::placeholders::_1, std::placeholders::_2));
+  }
+
+  virtual ~DataTxScheduler() {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (auto& [handle, session] : sessions_) {
+      stats_.dropped += session.messages_.size();
+    }
+    NXPLOG_UCIHAL_D("DataTx: queued=%llu sent=%llu dropped=%llu credits=%llu errors=%llu max_depth=%u"
+                    " avg_wait=%lluus max_wait=%lluus",
+      (unsigned long long)stats_.queued, (unsigned long long)stats_.sent,
+      (unsigned long long)stats_.dropped, (unsigned long long)stats_.credit_ntfs,
+      (unsigned long long)stats_.tx_errors, stats_.max_depth,
+      (unsigned long long)(stats_.sent ? stats_.total_wait_us / stats_.sent : 0),
+      (unsigned long long)stats_.max_wait_us);
+  }
+
+  uint16_t Send(uint16_t data_len, const uint8_t *p_data) {
+    if (data_len < UCI_MSG_HDR_SIZE) {
+      return 0;
+    }
+    bool last = !(p_data[0] & UCI_PBF_MASK);
+
+    std::lock_guard<std::mutex> lock(lock_);
+    if (segmenting_) {
+      return SendContinuation(data_len, p_data, last);
+    }
+
+    if (data_len < kCreditAvailOffset) {
+      NXPLOG_UCIHAL_E("DataTx: DATA_MESSAGE_SND too short, %u bytes", data_len);
+      return 0;
+    }
+    uint32_t handle = le_bytes_to_cpu<uint32_t>(&p_data[kHandleOffset]);
+
+    SessionQueue& session = sessions_[handle];
+    if (session.messages_.size() >= queue_depth_) {
+      NXPLOG_UCIHAL_E("DataTx: session 0x%08x queue full", handle);
+      stats_.dropped++;
+      if (!last) {
+        // The rest of the message is dropped too
+        segmenting_ = true;
+        segmenting_handle_ = handle;
+        segmenting_dropped_ = true;
+      }
+      return 0;
+    }
+    session.messages_.push_back(DataTxMessage{{std::vector<uint8_t>(p_data, p_data + data_len)}, Clock::now(), last});
+    stats_.queued++;
+    stats_.depth++;
+    if (stats_.depth > stats_.max_depth) {
+      stats_.max_depth = stats_.depth;
+    }
+    if (!last) {
+      segmenting_ = true;
+      segmenting_handle_ = handle;
+      segmenting_dropped_ = false;
+      return data_len;
+    }
+    MarkReady(handle, session);
+    Pump();
+    return data_len;
+  }
+
+  void GetStats(DataTxScheduler_Stats *stats) {
+    std::lock_guard<std::mutex> lock(lock_);
+    *stats = stats_;
+  }
+
+private:
+  // lock_ held, appends a continuation segment to the message in progress
+  uint16_t SendContinuation(uint16_t data_len, const uint8_t *p_data, bool last) {
+    uint32_t handle = segmenting_handle_;
+    if (last) {
+      segmenting_ = false;
+    }
+    auto it = sessions_.find(handle);
+    if (segmenting_dropped_ || it == sessions_.end() || it->second.messages_.empty() ||
+        it->second.messages_.back().complete_) {
+      // Head segment rejected, or session flushed meanwhile
+      return 0;
+    }
+    SessionQueue& session = it->second;
+    DataTxMessage& message = session.messages_.back();
+    message.segments_.emplace_back(p_data, p_data + data_len);
+    if (last) {
+      message.complete_ = true;
+      MarkReady(handle, session);
+      Pump();
+    }
+    return data_len;
+  }
+
+  // lock_ held
+  void MarkReady(uint32_t handle, SessionQueue& session) {
+    if (session.credit_ && !session.ready_ && !session.messages_.empty() &&
+        session.messages_.front().complete_) {
+      session.ready_ = true;
+      ready_sessions_.push_back(handle);
+    }
+  }
+
+  // lock_ held, releases one packet of every ready session
+  void Pump() {
+    while (!ready_sessions_.empty()) {
+      uint32_t handle = ready_sessions_.front();
+      ready_sessions_.pop_front();
+
+      auto it = sessions_.find(handle);
+      if (it == sessions_.end()) {
+        continue;
+      }
+      SessionQueue& session = it->second;
+      session.ready_ = false;
+      if (!session.credit_ || session.messages_.empty() || !session.messages_.front().complete_) {
+        continue;
+      }
+
+      DataTxMessage message = std::move(session.messages_.front());
+      session.messages_.pop_front();
+      session.credit_ = false;
+      stats_.depth--;
+
+      uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - message.queued_at_).count();
+      stats_.total_wait_us += wait_us;
+      if (wait_us > stats_.max_wait_us) {
+        stats_.max_wait_us = wait_us;
+      }
+
+      // Segments are queued back to back under lock_, they can't interleave
+      // with another message
+      tHAL_UWB_STATUS status = UWBSTATUS_PENDING;
+      for (const auto& segment : message.segments_) {
+        // SessionTrack was refreshed when the packet was queued, it must not
+        // be waited for here: Pump() also runs from rx handlers
+        status = phNxpUciHal_write_data_async(segment.size(), segment.data(),
+          [handle](const phNxpUciHal_CmdResult &result) {
+            if (result.status != UWBSTATUS_SUCCESS) {
+              NXPLOG_UCIHAL_E("DataTx: session 0x%08x write failed 0x%x", handle, result.status);
+            }
+          });
+        if (status != UWBSTATUS_PENDING) {
+          break;
+        }
+      }
+      if (status == UWBSTATUS_PENDING) {
+        stats_.sent++;
+      } else {
+        NXPLOG_UCIHAL_E("DataTx: session 0x%08x cannot be released 0x%x", handle, status);
+        stats_.dropped++;
+        session.credit_ = true;
+      }
+    }
+  }
+
+  void OnDataCreditNtf(size_t packet_len, const uint8_t *packet) {
+    if (packet_len <= kCreditAvailOffset) {
+      return;
+    }
+    uint32_t handle = le_bytes_to_cpu<uint32_t>(&packet[kHandleOffset]);
+    bool available = packet[kCreditAvailOffset] != 0;
+
+    std::lock_guard<std::mutex> lock(lock_);
+    stats_.credit_ntfs++;
+    SessionQueue& session = sessions_[handle];
+    session.credit_ = available;
+    MarkReady(handle, session);
+    Pump();
+  }
+
+  void OnDataTransmitStatusNtf(size_t packet_len, const uint8_t *packet) {
+    if (packet_len <= kTxStatusOffset) {
+      return;
+    }
+    uint8_t status = packet[kTxStatusOffset];
+    if (status != kTxStatusOk && status != kTxStatusRepetitionOk) {
+      std::lock_guard<std::mutex> lock(lock_);
+      stats_.tx_errors++;
+    }
+  }
+
+  void OnSessionStatusNtf(size_t packet_len, const uint8_t *packet) {
+    if (packet_len != UCI_MSG_SESSION_STATUS_NTF_LENGTH) {
+      return;
+    }
+    uint32_t handle = le_bytes_to_cpu<uint32_t>(&packet[UCI_MSG_SESSION_STATUS_NTF_HANDLE_OFFSET]);
+    uint8_t state = packet[UCI_MSG_SESSION_STATUS_NTF_STATE_OFFSET];
+    if (state != UCI_MSG_SESSION_STATE_DEINIT) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = sessions_.find(handle);
+    if (it == sessions_.end()) {
+      return;
+    }
+    if (!it->second.messages_.empty()) {
+      NXPLOG_UCIHAL_D("DataTx: session 0x%08x closed, flush %zu messages", handle, it->second.messages_.size());
+    }
+    stats_.dropped += it->second.messages_.size();
+    stats_.depth -= it->second.messages_.size();
+    sessions_.erase(it);
+  }
+};
+
+static std::unique_ptr<DataTxScheduler> gDataTxScheduler;
+static std::mutex gDataTxSchedulerLock;
+
+void DataTxScheduler_init()
+{
+  unsigned long enabled = 0;
+  if (!NxpConfig_GetNum(NAME_UWB_DATA_TX_SCHEDULER, &enabled, sizeof(enabled)) || !enabled) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(gDataTxSchedulerLock);
+  gDataTxScheduler = std::make_unique<DataTxScheduler>();
+}
+
+void DataTxScheduler_deinit()
+{
+  DataTxScheduler_dump();
+
+  std::unique_ptr<DataTxScheduler> scheduler;
+  {
+    std::lock_guard<std::mutex> lock(gDataTxSchedulerLock);
+    scheduler = std::move(gDataTxScheduler);
+  }
+  scheduler.reset();
+}
+
+bool DataTxScheduler_isEnabled()
+{
+  std::lock_guard<std::mutex> lock(gDataTxSchedulerLock);
+  return gDataTxScheduler != nullptr;
+}
+
+uint16_t DataTxScheduler_send(uint16_t data_len, const uint8_t *p_data)
+{
+  std::lock_guard<std::mutex> lock(gDataTxSchedulerLock);
+  if (!gDataTxScheduler) {
+    return 0;
+  }
+  return gDataTxScheduler->Send(data_len, p_data);
+}
+
+void DataTxScheduler_getStats(DataTxScheduler_Stats *stats)
+{
+  std::lock_guard<std::mutex> lock(gDataTxSchedulerLock);
+  if (gDataTxScheduler) {
+    gDataTxScheduler->GetStats(stats);
+  } else {
+    *stats = DataTxScheduler_Stats{};
+  }
+}
+
+void DataTxScheduler_dump()
+{
+  if (!DataTxScheduler_isEnabled()) {
+    return;
+  }
+
+  DataTxScheduler_Stats stats;
+  DataTxScheduler_getStats(&stats);
+  NXPLOG_UCIHAL_D("DataTxScheduler: queued=%llu sent=%llu dropped=%llu credit_ntfs=%llu"
+                  " tx_errors=%llu depth=%u max_depth=%u avg_wait=%lluus max_wait=%lluus",
+    (unsigned long long)stats.queued, (unsigned long long)stats.sent,
+    (unsigned long long)stats.dropped, (unsigned long long)stats.credit_ntfs,
+    (unsigned long long)stats.tx_errors, stats.depth, stats.max_depth,
+    (unsigned long long)(stats.sent ? stats.total_wait_us / stats.sent : 0),
+    (unsigned long long)stats.max_wait_us);
+}
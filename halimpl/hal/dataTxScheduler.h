@@ -0,0 +1,30 @@
+#ifndef _DATATXSCHEDULER_H_
+#define _DATATXSCHEDULER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+struct DataTxScheduler_Stats {
+  uint64_t queued;          // DATA messages accepted, segments of a message count once
+  uint64_t sent;            // DATA messages released to the UWBS
+  uint64_t dropped;         // Rejected on a full session queue or flushed
+  uint64_t credit_ntfs;     // SESSION_DATA_CREDIT_NTF received
+  uint64_t tx_errors;       // DATA_TRANSMIT_STATUS_NTF with an error status
+  uint32_t depth;           // Messages currently queued, all sessions
+  uint32_t max_depth;
+  uint64_t total_wait_us;   // Queued to released, sum over sent packets
+  uint64_t max_wait_us;
+};
+
+void DataTxScheduler_init();
+void DataTxScheduler_deinit();
+bool DataTxScheduler_isEnabled();
+
+// Queues a DATA_MESSAGE_SND packet, it is written once its session has a credit.
+// Continuation segments (after a PBF=1 packet) are added to the same message.
+// Returns data_len once queued, 0 when the session queue is full.
+uint16_t DataTxScheduler_send(uint16_t data_len, const uint8_t *p_data);
+void DataTxScheduler_getStats(DataTxScheduler_Stats *stats);
+// Logs the statistics, part of the TML stats dump
+void DataTxScheduler_dump();
+#endif
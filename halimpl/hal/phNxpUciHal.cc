@@ -15,12 +15,16 @@
  */
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <string.h>
 #include <list>
 #include <map>
 #include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -31,12 +35,17 @@
 #include <phNxpLog.h>
 #include <phNxpUciHal.h>
 #include <phNxpUciHal_Adaptation.h>
+#include <phNxpUciHal_cmd.h>
 #include <phNxpUciHal_ext.h>
+#include <phOsalUwb_Thread.h>
 #include <phTmlUwb_spi.h>
+#include <phTmlUwb_stats.h>
 
+#include "dataTxScheduler.h"
 #include "hal_nxpuwb.h"
 #include "phNxpConfig.h"
 #include "phNxpUciHal_utils.h"
+#include "rspTimeout.h"
 #include "sessionTrack.h"
 
 using namespace std;
@@ -50,19 +59,26 @@ bool uwb_device_initialized = false;
 bool uwb_get_platform_id = false;
 uint32_t timeoutTimerId = 0;
 char persistant_log_path[120];
-static uint8_t Rx_data[UCI_MAX_DATA_LEN];
 
 /**************** local methods used in this file only ************************/
 static void phNxpUciHal_write_complete(void* pContext,
                                        phTmlUwb_TransactInfo_t* pInfo);
+static uint16_t phNxpUciHal_write_packet(uint16_t data_len, const uint8_t* p_data);
 extern int phNxpUciHal_fw_download();
 static void phNxpUciHal_getVersionInfo();
+static void phNxpUciHal_dump_stats();
+
+// Serializes DATA packet writes, taken instead of CONCURRENCY_LOCK.
+// data_tx_closed is set by phNxpUciHal_close() before TML goes away, DATA
+// writers check it under the lock.
+static std::mutex data_tx_lock;
+static bool data_tx_closed = true;
 
 /*******************************************************************************
  * RX packet handler
  ******************************************************************************/
 struct phNxpUciHal_RxHandler {
-  // mt, gid, oid: packet type
+  // mt, gid, oid: packet type, gid/oid can be UCI_HAL_RX_ANY
   uint8_t mt;
   uint8_t gid;
   uint8_t oid;
@@ -71,6 +87,10 @@ struct phNxpUciHal_RxHandler {
   bool skip_reporting;
   bool run_once;
 
+  // cleared by phNxpUciHal_rx_handler_del() or once a run_once handler fired,
+  // snapshots taken before still reference the handler but skip it
+  std::atomic<bool> active;
+
   std::function<void(size_t packet_len, const uint8_t *packet)> callback;
 
   phNxpUciHal_RxHandler(uint8_t mt, uint8_t gid, uint8_t oid,
@@ -79,136 +99,351 @@ struct phNxpUciHal_RxHandler {
       mt(mt), gid(gid), oid(oid),
       skip_reporting(skip_reporting),
       run_once(run_once),
-      callback(callback) { }
+      active(true),
+      callback(std::move(callback)) { }
 };
 
-static std::list<std::shared_ptr<phNxpUciHal_RxHandler>> rx_handlers;
+// Immutable handler table indexed by (mt, gid, oid), handlers of a key are
+// kept in registration order
+struct phNxpUciHal_RxHandlerTable {
+  std::unordered_map<uint32_t, std::vector<std::shared_ptr<phNxpUciHal_RxHandler>>> index;
+  size_t nr_wildcards = 0;
+};
+
+static inline uint32_t phNxpUciHal_rx_handler_key(uint8_t mt, uint8_t gid, uint8_t oid)
+{
+  return (mt << 16) | (gid << 8) | oid;
+}
+
+// Writers copy the table under rx_handlers_lock and bump rx_handlers_gen.
+// The dispatcher (client thread, or the reader under REENTRANCE_LOCK in inline
+// dispatch mode, never two at a time) keeps its own reference to the last
+// table it has seen and only takes the lock to pick up a newer one, callbacks
+// run without any lock and can add or delete handlers.
+static std::shared_ptr<const phNxpUciHal_RxHandlerTable> rx_handlers;
 static std::mutex rx_handlers_lock;
+static std::atomic<uint32_t> rx_handlers_gen;
+
+static std::shared_ptr<const phNxpUciHal_RxHandlerTable> rx_handlers_snapshot;
+static uint32_t rx_handlers_snapshot_gen;
+
+// Handler whose callback is running and the thread running it.
+// phNxpUciHal_rx_handler_del() waits for the callback to return, unless it's
+// called from the callback itself, so that the state it captures can be freed.
+static std::mutex rx_callback_lock;
+static std::condition_variable rx_callback_cv;
+static const phNxpUciHal_RxHandler *rx_callback_running;
+static std::thread::id rx_callback_thread;
+
+// RX fragment reassembly, same owner as the snapshot.
+// rx_streaming[mt] is set while the fragments of the message in progress are
+// reported as they arrive.
+static UciReassembler rx_reassembler(UCI_MAX_REASSEMBLED_LEN);
+static std::array<bool, 8> rx_streaming;
+
+static void phNxpUciHal_rx_handler_update(
+  const std::function<void(phNxpUciHal_RxHandlerTable &table)> &update)
+{
+  std::lock_guard<std::mutex> guard(rx_handlers_lock);
+  auto table = rx_handlers ? std::make_shared<phNxpUciHal_RxHandlerTable>(*rx_handlers)
+                           : std::make_shared<phNxpUciHal_RxHandlerTable>();
+  update(*table);
+  rx_handlers = std::move(table);
+  rx_handlers_gen.fetch_add(1, std::memory_order_release);
+}
 
 std::shared_ptr<phNxpUciHal_RxHandler> phNxpUciHal_rx_handler_add(
   uint8_t mt, uint8_t gid, uint8_t oid,
   bool skip_reporting, bool run_once,
   std::function<void(size_t packet_len, const uint8_t *packet)> callback)
 {
+  if (gid == UCI_HAL_RX_ANY) {
+    oid = UCI_HAL_RX_ANY;
+  }
   auto handler = std::make_shared<phNxpUciHal_RxHandler>(mt, gid, oid,
-    skip_reporting, run_once, callback);
-  std::lock_guard<std::mutex> guard(rx_handlers_lock);
-  rx_handlers.push_back(handler);
+    skip_reporting, run_once, std::move(callback));
+  phNxpUciHal_rx_handler_update([&handler](phNxpUciHal_RxHandlerTable &table) {
+    table.index[phNxpUciHal_rx_handler_key(handler->mt, handler->gid, handler->oid)].push_back(handler);
+    if (handler->oid == UCI_HAL_RX_ANY) {
+      table.nr_wildcards++;
+    }
+  });
   return handler;
 }
 
 void phNxpUciHal_rx_handler_del(std::shared_ptr<phNxpUciHal_RxHandler> handler)
 {
-  std::lock_guard<std::mutex> guard(rx_handlers_lock);
-  rx_handlers.remove(handler);
+  if (!handler) {
+    return;
+  }
+  handler->active = false;
+  phNxpUciHal_rx_handler_update([&handler](phNxpUciHal_RxHandlerTable &table) {
+    auto it = table.index.find(phNxpUciHal_rx_handler_key(handler->mt, handler->gid, handler->oid));
+    if (it == table.index.end()) {
+      return;
+    }
+    auto& handlers = it->second;
+    auto pos = std::find(handlers.begin(), handlers.end(), handler);
+    if (pos == handlers.end()) {
+      return;
+    }
+    handlers.erase(pos);
+    if (handlers.empty()) {
+      table.index.erase(it);
+    }
+    if (handler->oid == UCI_HAL_RX_ANY) {
+      table.nr_wildcards--;
+    }
+  });
+
+  // Grace period: the callback may have been picked before active was cleared
+  std::unique_lock<std::mutex> lock(rx_callback_lock);
+  rx_callback_cv.wait(lock, [&handler] {
+    return rx_callback_running != handler.get() ||
+           rx_callback_thread == std::this_thread::get_id();
+  });
 }
 
-static void phNxpUciHal_rx_handler_check(size_t packet_len, const uint8_t *packet)
+static bool phNxpUciHal_rx_handler_run(
+  const phNxpUciHal_RxHandlerTable &table, uint32_t key,
+  size_t packet_len, const uint8_t *packet)
 {
-  const uint8_t mt = ((packet[0]) & UCI_MT_MASK) >> UCI_MT_SHIFT;
-  const uint8_t gid = packet[0] & UCI_GID_MASK;
-  const uint8_t oid = packet[1] & UCI_OID_MASK;
+  auto it = table.index.find(key);
+  if (it == table.index.end()) {
+    return false;
+  }
 
-  std::lock_guard<std::mutex> guard(rx_handlers_lock);
+  bool skip_reporting = false;
+  for (const auto& handler : it->second) {
+    if (!handler->active.load(std::memory_order_acquire)) {
+      continue;
+    }
 
-  for (auto handler : rx_handlers) {
-    if (mt == handler->mt && gid == handler->gid && oid == handler->oid) {
+    // Published before active is checked again, so that a concurrent
+    // phNxpUciHal_rx_handler_del() either sees it running or isn't run
+    {
+      std::lock_guard<std::mutex> lock(rx_callback_lock);
+      rx_callback_running = handler.get();
+      rx_callback_thread = std::this_thread::get_id();
+    }
+    bool run = handler->run_once ? handler->active.exchange(false) : handler->active.load();
+    if (run) {
       handler->callback(packet_len, packet);
-      if (handler->skip_reporting) {
-        nxpucihal_ctrl.isSkipPacket = 1;
-      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(rx_callback_lock);
+      rx_callback_running = nullptr;
+    }
+    rx_callback_cv.notify_all();
+    if (!run) {
+      continue;
+    }
+
+    if (handler->skip_reporting) {
+      skip_reporting = true;
+    }
+    if (handler->run_once) {
+      phNxpUciHal_rx_handler_del(handler);
     }
   }
-  rx_handlers.remove_if([mt, gid, oid](auto& handler) {
-    return mt == handler->mt && gid == handler->gid && oid == handler->oid && handler->run_once;
-  });
+  return skip_reporting;
+}
+
+// Dispatcher only
+static void phNxpUciHal_rx_handler_refresh(void)
+{
+  uint32_t gen = rx_handlers_gen.load(std::memory_order_acquire);
+  if (gen != rx_handlers_snapshot_gen) {
+    std::lock_guard<std::mutex> guard(rx_handlers_lock);
+    rx_handlers_snapshot = rx_handlers;
+    rx_handlers_snapshot_gen = gen;
+  }
+}
+
+// Returns true if an active handler of the packet's key would keep it from
+// the upper layer, without running anything
+static bool phNxpUciHal_rx_handler_consumes(const UciPacketView& pkt)
+{
+  phNxpUciHal_rx_handler_refresh();
+
+  const auto& table = rx_handlers_snapshot;
+  if (!table || table->index.empty()) {
+    return false;
+  }
+
+  auto consumes = [&table](uint32_t key) -> bool {
+    auto it = table->index.find(key);
+    if (it == table->index.end()) {
+      return false;
+    }
+    return std::any_of(it->second.begin(), it->second.end(), [](const auto& handler) {
+      return handler->skip_reporting && handler->active.load(std::memory_order_acquire);
+    });
+  };
+
+  if (consumes(phNxpUciHal_rx_handler_key(pkt.mt, pkt.gid, pkt.oid))) {
+    return true;
+  }
+  return table->nr_wildcards &&
+         (consumes(phNxpUciHal_rx_handler_key(pkt.mt, pkt.gid, UCI_HAL_RX_ANY)) ||
+          consumes(phNxpUciHal_rx_handler_key(pkt.mt, UCI_HAL_RX_ANY, UCI_HAL_RX_ANY)));
+}
+
+// Returns true if a handler asked not to report the packet to the upper layer
+static bool phNxpUciHal_rx_handler_check(const UciPacketView& pkt)
+{
+  const size_t packet_len = pkt.len;
+  const uint8_t *packet = pkt.data;
+
+  phNxpUciHal_rx_handler_refresh();
+
+  // Hold the snapshot, callbacks may update the table
+  auto table = rx_handlers_snapshot;
+  if (!table || table->index.empty()) {
+    return false;
+  }
+
+  bool skip_reporting =
+    phNxpUciHal_rx_handler_run(*table, phNxpUciHal_rx_handler_key(pkt.mt, pkt.gid, pkt.oid), packet_len, packet);
+  if (table->nr_wildcards) {
+    skip_reporting |= phNxpUciHal_rx_handler_run(*table,
+      phNxpUciHal_rx_handler_key(pkt.mt, pkt.gid, UCI_HAL_RX_ANY), packet_len, packet);
+    skip_reporting |= phNxpUciHal_rx_handler_run(*table,
+      phNxpUciHal_rx_handler_key(pkt.mt, UCI_HAL_RX_ANY, UCI_HAL_RX_ANY), packet_len, packet);
+  }
+  return skip_reporting;
 }
 
 static void phNxpUciHal_rx_handler_destroy(void)
 {
   std::lock_guard<std::mutex> guard(rx_handlers_lock);
-  rx_handlers.clear();
+  rx_handlers.reset();
+  rx_handlers_snapshot.reset();
+  rx_handlers_snapshot_gen = rx_handlers_gen.fetch_add(1, std::memory_order_release) + 1;
 }
 
 /******************************************************************************
- * Function         phNxpUciHal_client_thread
+ * Function         phNxpUciHal_client_dispatch
  *
- * Description      This function is a thread handler which handles all TML and
- *                  UCI messages.
+ * Description      Handles one message of the client thread.
+ *                  Deferred calls (TML read and write completions, timers)
+ *                  run without REENTRANCE_LOCK: the state they touch is owned
+ *                  by the client thread, handed over through semaphores, or
+ *                  published as snapshots (rx handlers).
+ *                  Only the HAL event callbacks take REENTRANCE_LOCK, unless
+ *                  TML dispatches reads inline: the reader thread then runs
+ *                  the read callbacks under REENTRANCE_LOCK and every message
+ *                  takes it.
  *
- * Returns          void
+ * Returns          false once the client thread has to stop
  *
  ******************************************************************************/
-static void phNxpUciHal_client_thread(phNxpUciHal_Control_t* p_nxpucihal_ctrl)
+static bool phNxpUciHal_client_dispatch(const std::shared_ptr<phLibUwb_Message>& msg)
 {
-  NXPLOG_UCIHAL_D("thread started");
-
   bool thread_running = true;
 
-  while (thread_running) {
-    /* Fetch next message from the UWB stack message queue */
-    auto msg = p_nxpucihal_ctrl->gDrvCfg.pClientMq->recv();
+  if (msg->eMsgType == PH_LIBUWB_DEFERREDCALL_MSG) {
+    phLibUwb_DeferredCall_t* deferCall = (phLibUwb_DeferredCall_t*)(msg->pMsgData);
+    if (phTmlUwb_IsInlineDispatch()) {
+      REENTRANCE_LOCK();
+      deferCall->pCallback(deferCall->pParameter);
+      REENTRANCE_UNLOCK();
+    } else {
+      deferCall->pCallback(deferCall->pParameter);
+    }
+    return true;
+  }
 
-    if (!thread_running) {
+  REENTRANCE_LOCK();
+  switch (msg->eMsgType) {
+    case UCI_HAL_OPEN_CPLT_MSG: {
+      if (nxpucihal_ctrl.p_uwb_stack_cback != NULL) {
+        /* Send the event */
+        (*nxpucihal_ctrl.p_uwb_stack_cback)(HAL_UWB_OPEN_CPLT_EVT,
+                                            HAL_UWB_STATUS_OK);
+      }
       break;
     }
 
-    switch (msg->eMsgType) {
-      case PH_LIBUWB_DEFERREDCALL_MSG: {
-        phLibUwb_DeferredCall_t* deferCall = (phLibUwb_DeferredCall_t*)(msg->pMsgData);
-
-        REENTRANCE_LOCK();
-        deferCall->pCallback(deferCall->pParameter);
-        REENTRANCE_UNLOCK();
-
-        break;
+    case UCI_HAL_CLOSE_CPLT_MSG: {
+      if (nxpucihal_ctrl.p_uwb_stack_cback != NULL) {
+        /* Send the event */
+        (*nxpucihal_ctrl.p_uwb_stack_cback)(HAL_UWB_CLOSE_CPLT_EVT,
+                                            HAL_UWB_STATUS_OK);
       }
+      thread_running = false;
+      break;
+    }
 
-      case UCI_HAL_OPEN_CPLT_MSG: {
-        REENTRANCE_LOCK();
-        if (nxpucihal_ctrl.p_uwb_stack_cback != NULL) {
-          /* Send the event */
-          (*nxpucihal_ctrl.p_uwb_stack_cback)(HAL_UWB_OPEN_CPLT_EVT,
-                                              HAL_UWB_STATUS_OK);
-        }
-        REENTRANCE_UNLOCK();
-        break;
+    case UCI_HAL_INIT_CPLT_MSG: {
+      if (nxpucihal_ctrl.p_uwb_stack_cback != NULL) {
+        /* Send the event */
+        (*nxpucihal_ctrl.p_uwb_stack_cback)(HAL_UWB_INIT_CPLT_EVT,
+                                            HAL_UWB_STATUS_OK);
       }
+      break;
+    }
 
-      case UCI_HAL_CLOSE_CPLT_MSG: {
-        REENTRANCE_LOCK();
-        if (nxpucihal_ctrl.p_uwb_stack_cback != NULL) {
-          /* Send the event */
-          (*nxpucihal_ctrl.p_uwb_stack_cback)(HAL_UWB_CLOSE_CPLT_EVT,
-                                              HAL_UWB_STATUS_OK);
-        }
-        thread_running = false;
-        REENTRANCE_UNLOCK();
-        break;
+    case UCI_HAL_ERROR_MSG: {
+      if (nxpucihal_ctrl.p_uwb_stack_cback != NULL) {
+        /* Send the event */
+        (*nxpucihal_ctrl.p_uwb_stack_cback)(HAL_UWB_ERROR_EVT,
+                                            HAL_UWB_ERROR_EVT);
       }
+      break;
+    }
+  }
+  REENTRANCE_UNLOCK();
+  return thread_running;
+}
 
-      case UCI_HAL_INIT_CPLT_MSG: {
-        REENTRANCE_LOCK();
-        if (nxpucihal_ctrl.p_uwb_stack_cback != NULL) {
-          /* Send the event */
-          (*nxpucihal_ctrl.p_uwb_stack_cback)(HAL_UWB_INIT_CPLT_EVT,
-                                              HAL_UWB_STATUS_OK);
-        }
-        REENTRANCE_UNLOCK();
-        break;
-      }
+/******************************************************************************
+ * Function         phNxpUciHal_client_thread
+ *
+ * Description      This function is a thread handler which handles all TML and
+ *                  UCI messages.
+ *                  With UWB_CLIENT_BURST_DRAIN, the messages pending in a
+ *                  lane on a wakeup are fetched from the queue at once, up to
+ *                  UCI_HAL_CLIENT_BURST_MAX at a time. Messages queued to a
+ *                  higher priority lane meanwhile are still handled before
+ *                  the rest of the batch.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void phNxpUciHal_client_thread(phNxpUciHal_Control_t* p_nxpucihal_ctrl)
+{
+  NXPLOG_UCIHAL_D("thread started");
 
-      case UCI_HAL_ERROR_MSG: {
-        REENTRANCE_LOCK();
-        if (nxpucihal_ctrl.p_uwb_stack_cback != NULL) {
-          /* Send the event */
-          (*nxpucihal_ctrl.p_uwb_stack_cback)(HAL_UWB_ERROR_EVT,
-                                              HAL_UWB_ERROR_EVT);
-        }
-        REENTRANCE_UNLOCK();
-        break;
+  phOsalUwb_Thread_ApplyRtProfile(phOsalUwb_ThreadRole_t::Client);
+
+  unsigned long burst_drain = 0;
+  NxpConfig_GetNum(NAME_UWB_CLIENT_BURST_DRAIN, &burst_drain, sizeof(burst_drain));
+  const size_t max_count = burst_drain ? UCI_HAL_CLIENT_BURST_MAX : 1;
+
+  std::shared_ptr<phLibUwb_Message> msgs[UCI_HAL_CLIENT_BURST_MAX];
+  bool thread_running = true;
+
+  auto& mq = p_nxpucihal_ctrl->gDrvCfg.pClientMq;
+
+  while (thread_running) {
+    /* Fetch next message(s) from the UWB stack message queue */
+    size_t lane = 0;
+    size_t count = mq->recv_batch(msgs, max_count, &lane);
+
+    for (size_t i = 0; i < count && thread_running; i++) {
+      // Messages of a higher priority lane queued meanwhile go first
+      while (thread_running && mq->pending_before(lane)) {
+        thread_running = phNxpUciHal_client_dispatch(mq->try_recv());
+      }
+      if (thread_running) {
+        thread_running = phNxpUciHal_client_dispatch(msgs[i]);
       }
     }
+
+    for (size_t i = 0; i < count; i++) {
+      msgs[i].reset();
+    }
   }
 
   NXPLOG_UCIHAL_D("NxpUciHal thread stopped");
@@ -218,13 +453,19 @@ static void phNxpUciHal_client_thread(phNxpUciHal_Control_t* p_nxpucihal_ctrl)
  * Function         phNxpUciHal_parse
  *
  * Description      This function parses all the data passing through the HAL.
+ *                  A command patched by the HAL is written to
+ *                  nxpucihal_ctrl.p_cmd_data, *pp_data and *p_data_len are
+ *                  then updated to it. Other packets are sent from the
+ *                  caller's buffer.
  *
  * Returns          It returns true if the incoming command to be skipped.
  *
  ******************************************************************************/
-bool phNxpUciHal_parse(uint16_t data_len, const uint8_t *p_data)
+bool phNxpUciHal_parse(uint16_t *p_data_len, const uint8_t **pp_data)
 {
   bool ret = false;
+  const uint16_t data_len = *p_data_len;
+  const uint8_t *p_data = *pp_data;
 
   if (data_len < UCI_MSG_HDR_SIZE)
     return false;
@@ -249,12 +490,15 @@ bool phNxpUciHal_parse(uint16_t data_len, const uint8_t *p_data)
     } else if ((gid == UCI_GID_PROPRIETARY_0x0F) && (oid == SET_VENDOR_SET_CALIBRATION)) {
         if (p_data[UCI_MSG_HDR_SIZE + 1] ==
             VENDOR_CALIB_PARAM_TX_POWER_PER_ANTENNA) {
-          phNxpUciHal_handle_set_calibration(p_data, data_len);
+          if (phNxpUciHal_handle_set_calibration(p_data, data_len)) {
+            *pp_data = nxpucihal_ctrl.p_cmd_data;
+            *p_data_len = nxpucihal_ctrl.cmd_len;
+          }
         }
     } else if ((gid == UCI_GID_SESSION_MANAGE) && (oid == UCI_MSG_SESSION_SET_APP_CONFIG)) {
-      return phNxpUciHal_handle_set_app_config(&nxpucihal_ctrl.cmd_len, nxpucihal_ctrl.p_cmd_data);
+      return phNxpUciHal_handle_set_app_config(p_data_len, pp_data);
     } else if ((gid == UCI_GID_SESSION_MANAGE) && (oid == UCI_MSG_SESSION_STATE_INIT)) {
-      SessionTrack_onSessionInit(nxpucihal_ctrl.cmd_len, nxpucihal_ctrl.p_cmd_data);
+      SessionTrack_onSessionInit(data_len, p_data);
     }
   } else {
     ret = false;
@@ -278,7 +522,8 @@ bool phNxpUciHal_parse(uint16_t data_len, const uint8_t *p_data)
  ******************************************************************************/
 tHAL_UWB_STATUS phNxpUciHal_open(uwb_stack_callback_t* p_cback, uwb_stack_data_callback_t* p_data_cback)
 {
-  static const char uwb_dev_node[256] = "/dev/srxxx";
+  static char uwb_dev_node[256] = "/dev/srxxx";
+  unsigned long link_type = ENUM_LINK_TYPE_SPI;
   tHAL_UWB_STATUS wConfigStatus = UWBSTATUS_SUCCESS;
 
   if (nxpucihal_ctrl.halStatus == HAL_STATUS_OPEN) {
@@ -291,6 +536,9 @@ tHAL_UWB_STATUS phNxpUciHal_open(uwb_stack_callback_t* p_cback, uwb_stack_data_c
   /* initialize trace level */
   phNxpLog_InitializeLogLevel();
 
+  /* Thread priorities and memory locking, before any HAL thread is created */
+  phOsalUwb_Thread_LoadRtProfile();
+
   /*Create the timer for extns write response*/
   timeoutTimerId = phOsalUwb_Timer_Create();
 
@@ -301,6 +549,15 @@ tHAL_UWB_STATUS phNxpUciHal_open(uwb_stack_callback_t* p_cback, uwb_stack_data_c
 
   CONCURRENCY_LOCK();
 
+  {
+    std::lock_guard<std::mutex> lock(data_tx_lock);
+    data_tx_closed = false;
+  }
+
+  // Optional override, e.g. to run the HAL against a simulated UWBS
+  NxpConfig_GetNum(NAME_UWB_TML_LINK_TYPE, &link_type, sizeof(link_type));
+  NxpConfig_GetStr(NAME_UWB_TML_DEVICE_NODE, uwb_dev_node, sizeof(uwb_dev_node));
+
   NXPLOG_UCIHAL_E("Assigning the default helios Node: %s", uwb_dev_node);
   /* By default HAL status is HAL_STATUS_OPEN */
   nxpucihal_ctrl.halStatus = HAL_STATUS_OPEN;
@@ -310,11 +567,13 @@ tHAL_UWB_STATUS phNxpUciHal_open(uwb_stack_callback_t* p_cback, uwb_stack_data_c
   nxpucihal_ctrl.fw_dwnld_mode = false;
 
   /* Configure hardware link */
-  nxpucihal_ctrl.gDrvCfg.pClientMq = std::make_shared<MessageQueue<phLibUwb_Message>>("Client");
-  nxpucihal_ctrl.gDrvCfg.nLinkType = ENUM_LINK_TYPE_SPI;
+  nxpucihal_ctrl.gDrvCfg.pClientMq = std::make_shared<MessageQueue<phLibUwb_Message>>(
+    "Client", MessageQueue<phLibUwb_Message>::kDefaultCapacity, PH_LIBUWB_LANE_COUNT);
+  nxpucihal_ctrl.gDrvCfg.nLinkType = (phLibUwb_eConfigLinkType)link_type;
 
   /* Initialize TML layer */
-  wConfigStatus = phTmlUwb_Init(uwb_dev_node, nxpucihal_ctrl.gDrvCfg.pClientMq);
+  wConfigStatus = phTmlUwb_Init(uwb_dev_node, nxpucihal_ctrl.gDrvCfg.nLinkType,
+                                nxpucihal_ctrl.gDrvCfg.pClientMq);
   if (wConfigStatus != UWBSTATUS_SUCCESS) {
     NXPLOG_UCIHAL_E("phTmlUwb_Init Failed");
     goto clean_and_return;
@@ -326,6 +585,13 @@ tHAL_UWB_STATUS phNxpUciHal_open(uwb_stack_callback_t* p_cback, uwb_stack_data_c
 
   nxpucihal_ctrl.halStatus = HAL_STATUS_OPEN;
 
+  RspTimeout_init();
+  phTmlUwb_Stats_SetDumpCb(phNxpUciHal_dump_stats);
+
+  /* Asynchronous DATA writes, the worker starts on first use */
+  phNxpUciHal_cmd_engine_init();
+  DataTxScheduler_init();
+
   CONCURRENCY_UNLOCK();
 
   // Per-chip (SR1XX or SR200) implementation
@@ -337,6 +603,10 @@ tHAL_UWB_STATUS phNxpUciHal_open(uwb_stack_callback_t* p_cback, uwb_stack_data_c
   return UWBSTATUS_SUCCESS;
 
 clean_and_return:
+  {
+    std::lock_guard<std::mutex> lock(data_tx_lock);
+    data_tx_closed = true;
+  }
   CONCURRENCY_UNLOCK();
 
   /* Report error status */
@@ -345,6 +615,7 @@ clean_and_return:
   nxpucihal_ctrl.p_uwb_stack_cback = NULL;
   nxpucihal_ctrl.p_uwb_stack_data_cback = NULL;
   phNxpUciHal_cleanup_monitor();
+  phOsalUwb_Thread_UnloadRtProfile();
   nxpucihal_ctrl.halStatus = HAL_STATUS_CLOSE;
   return wConfigStatus;
 }
@@ -369,6 +640,16 @@ tHAL_UWB_STATUS phNxpUciHal_write(uint16_t data_len, const uint8_t* p_data) {
 
   SessionTrack_keepAlive();
 
+  // DATA packets wait for a session credit in the scheduler, or are written
+  // right away without waiting for an in-flight command
+  if (data_len >= UCI_MSG_HDR_SIZE &&
+      ((p_data[0] & UCI_MT_MASK) >> UCI_MT_SHIFT) == UCI_MT_DATA) {
+    if (DataTxScheduler_isEnabled()) {
+      return DataTxScheduler_send(data_len, p_data);
+    }
+    return phNxpUciHal_write_data(data_len, p_data);
+  }
+
   CONCURRENCY_LOCK();
   phNxpUciHal_process_ext_cmd_rsp(data_len, p_data, &len);
   CONCURRENCY_UNLOCK();
@@ -389,58 +670,98 @@ tHAL_UWB_STATUS phNxpUciHal_write(uint16_t data_len, const uint8_t* p_data) {
  *
  ******************************************************************************/
 tHAL_UWB_STATUS phNxpUciHal_write_unlocked(uint16_t data_len, const uint8_t* p_data) {
-  tHAL_UWB_STATUS status;
-  uint8_t mt, pbf, gid, oid;
+  uint16_t tx_len;
+  const uint8_t* p_tx_data;
 
-  phNxpUciHal_Sem_t cb_data;
-  /* Create the local semaphore */
-  if (phNxpUciHal_init_cb_data(&cb_data, NULL) != UWBSTATUS_SUCCESS) {
-    NXPLOG_UCIHAL_D("phNxpUciHal_write_unlocked Create cb data failed");
-    data_len = 0;
-    goto clean_and_return;
+  if ((data_len > UCI_MAX_DATA_LEN) || (data_len < UCI_PKT_HDR_LEN)) {
+    NXPLOG_UCIHAL_E("Invalid data_len");
+    return 0;
   }
 
+  /* Vendor Specific Parsing logic, the packet is written from the caller's
+   * buffer unless the HAL has to patch it. Either stays valid until the
+   * write completion. */
+  tx_len = data_len;
+  p_tx_data = p_data;
+  nxpucihal_ctrl.hal_parse_enabled = phNxpUciHal_parse(&tx_len, &p_tx_data);
+  if (nxpucihal_ctrl.hal_parse_enabled) {
+    return data_len;
+  }
+
+  if (phNxpUciHal_write_packet(tx_len, p_tx_data) != tx_len) {
+    return 0;
+  }
+  return data_len;
+}
+
+/******************************************************************************
+ * Function         phNxpUciHal_write_data
+ *
+ * Description      Writes a DATA packet to UWBC. DATA packets get no RSP, so
+ *                  they don't take CONCURRENCY_LOCK and are not held back by
+ *                  a command waiting for its response. data_tx_lock keeps
+ *                  them in submission order, hence in order per session.
+ *
+ * Returns          It returns number of bytes successfully written to UWBC.
+ *
+ ******************************************************************************/
+uint16_t phNxpUciHal_write_data(uint16_t data_len, const uint8_t* p_data) {
   if ((data_len > UCI_MAX_DATA_LEN) || (data_len < UCI_PKT_HDR_LEN)) {
     NXPLOG_UCIHAL_E("Invalid data_len");
-    data_len = 0;
-    goto clean_and_return;
+    return 0;
   }
 
-  /* Create local copy of cmd_data */
-  memcpy(nxpucihal_ctrl.p_cmd_data, p_data, data_len);
-  nxpucihal_ctrl.cmd_len = data_len;
+  std::lock_guard<std::mutex> lock(data_tx_lock);
+  if (data_tx_closed) {
+    NXPLOG_UCIHAL_E("DATA write after close");
+    return 0;
+  }
+  return phNxpUciHal_write_packet(data_len, p_data);
+}
 
-  data_len = nxpucihal_ctrl.cmd_len;
-  UCI_MSG_PRS_HDR0(p_data, mt, pbf, gid);
-  UCI_MSG_PRS_HDR1(p_data, oid);
+/******************************************************************************
+ * Function         phNxpUciHal_write_packet
+ *
+ * Description      Writes one packet as is and waits till write callback
+ *                  provide the result of write process.
+ *
+ * Returns          It returns number of bytes successfully written to UWBC.
+ *
+ ******************************************************************************/
+static uint16_t phNxpUciHal_write_packet(uint16_t data_len, const uint8_t* p_data) {
+  tHAL_UWB_STATUS status;
 
-  /* Vendor Specific Parsing logic */
-  nxpucihal_ctrl.hal_parse_enabled =
-      phNxpUciHal_parse(nxpucihal_ctrl.cmd_len, nxpucihal_ctrl.p_cmd_data);
-  if (nxpucihal_ctrl.hal_parse_enabled) {
-    goto clean_and_return;
+  /* Get a completion object from the pool */
+  phNxpUciHal_Sem_t* p_cb_data = phNxpUciHal_acquire_cb_data(NULL);
+  if (p_cb_data == NULL) {
+    NXPLOG_UCIHAL_D("phNxpUciHal_write_packet Create cb data failed");
+    return 0;
   }
+
+  /* Kept out of the pool until TML is done with it, the wait below may be
+   * cut short by phNxpUciHal_releaseall_cb_data() */
+  phNxpUciHal_hold_cb_data(p_cb_data);
   status = phTmlUwb_Write(
-      (uint8_t*)nxpucihal_ctrl.p_cmd_data, (uint16_t)nxpucihal_ctrl.cmd_len,
+      p_data, data_len,
       (pphTmlUwb_TransactCompletionCb_t)&phNxpUciHal_write_complete,
-      (void*)&cb_data);
-
+      (void*)p_cb_data);
 
   if (status != UWBSTATUS_PENDING) {
-    NXPLOG_UCIHAL_E("write_unlocked status error");
+    NXPLOG_UCIHAL_E("write_packet status error");
+    phNxpUciHal_unhold_cb_data(p_cb_data);
     data_len = 0;
     goto clean_and_return;
   }
 
   /* Wait for callback response */
-  if (SEM_WAIT(&cb_data)) {
-    NXPLOG_UCIHAL_E("write_unlocked semaphore error");
+  if (SEM_WAIT(p_cb_data)) {
+    NXPLOG_UCIHAL_E("write_packet semaphore error");
     data_len = 0;
     goto clean_and_return;
   }
 
 clean_and_return:
-  phNxpUciHal_cleanup_cb_data(&cb_data);
+  phNxpUciHal_release_cb_data(p_cb_data);
   return data_len;
 }
 
@@ -464,141 +785,256 @@ static void phNxpUciHal_write_complete(void* pContext,
   p_cb_data->status = pInfo->wStatus;
 
   SEM_POST(p_cb_data);
+  /* p_cb_data may be recycled from here on */
+  phNxpUciHal_unhold_cb_data(p_cb_data);
 
   return;
 }
 
 /******************************************************************************
- * Function         phNxpUciHal_read_complete
+ * Function         phNxpUciHal_dump_stats
  *
- * Description      This function is called whenever there is an UCI packet
- *                  received from UWBC. It could be RSP or NTF packet. This
- *                  function provide the received UCI packet to libuwb-uci
- *                  using data callback of libuwb-uci.
- *                  There is a pending read called from each
- *                  phNxpUciHal_read_complete so each a packet received from
- *                  UWBC can be provide to libuwb-uci.
+ * Description      TML stats dump callback, logs the HAL statistics next to
+ *                  the TML ones.
  *
  * Returns          void.
  *
  ******************************************************************************/
-void phNxpUciHal_read_complete(void* pContext, phTmlUwb_TransactInfo_t* pInfo)
+static void phNxpUciHal_dump_stats()
 {
-  UNUSED(pContext);
+  RspTimeout_dump();
+  DataTxScheduler_dump();
+}
 
-  if (pInfo->wStatus != UWBSTATUS_SUCCESS) {
-    NXPLOG_UCIHAL_E("read error status = 0x%x", pInfo->wStatus);
+/******************************************************************************
+ * Function         phNxpUciHal_report_packets
+ *
+ * Description      Sends the UCI packets of a buffer to libuwb-uci as they
+ *                  were received.
+ *
+ * Returns          void.
+ *
+ ******************************************************************************/
+static void phNxpUciHal_report_packets(const uint8_t *p_packets, size_t len)
+{
+  if (nxpucihal_ctrl.p_uwb_stack_data_cback == NULL) {
     return;
   }
 
-  NXPLOG_UCIHAL_D("read successful status = 0x%x", pInfo->wStatus);
-
-  for (int32_t index = 0; index < pInfo->wLength; )
-  {
-    uint8_t extBitSet = (pInfo->pBuff[index + EXTND_LEN_INDICATOR_OFFSET] & EXTND_LEN_INDICATOR_OFFSET_MASK);
-    int32_t length = pInfo->pBuff[index + NORMAL_MODE_LENGTH_OFFSET];
-    if (extBitSet || ((pInfo->pBuff[index] & UCI_MT_MASK) == 0x00)) {
-     length = (length << EXTENDED_MODE_LEN_SHIFT) | pInfo->pBuff[index + EXTENDED_MODE_LEN_OFFSET] ;
+  UciPacketView pkt;
+  while (len > 0 && UciPacketView::parse(p_packets, len, &pkt)) {
+    if (pkt.len <= UCI_MAX_PAYLOAD_LEN) {
+      // libuwb-uci takes a non-const buffer, packets are owned by TML or the reassembler
+      (*nxpucihal_ctrl.p_uwb_stack_data_cback)(pkt.len, const_cast<uint8_t*>(pkt.data));
     }
-    length += UCI_MSG_HDR_SIZE;
-    NXPLOG_UCIHAL_V("read successful length = %d", length);
-
-    nxpucihal_ctrl.p_rx_data = &pInfo->pBuff[index];
-    nxpucihal_ctrl.rx_data_len = length;
-    phNxpUciHal_print_packet(NXP_TML_UCI_RSP_NTF_UWBS_2_AP, nxpucihal_ctrl.p_rx_data, nxpucihal_ctrl.rx_data_len);
-
-    uint8_t mt = ((nxpucihal_ctrl.p_rx_data[0]) & UCI_MT_MASK) >> UCI_MT_SHIFT;
-    uint8_t gid = nxpucihal_ctrl.p_rx_data[0] & UCI_GID_MASK;
-    uint8_t oid = nxpucihal_ctrl.p_rx_data[1] & UCI_OID_MASK;
-    uint8_t pbf = (nxpucihal_ctrl.p_rx_data[0] & UCI_PBF_MASK) >> UCI_PBF_SHIFT;
+    p_packets += pkt.len;
+    len -= pkt.len;
+  }
+}
 
-    nxpucihal_ctrl.isSkipPacket = 0;
+/******************************************************************************
+ * Function         phNxpUciHal_rx_needs_message
+ *
+ * Description      Tells whether a fragmented message has to be complete
+ *                  before it can be reported to libuwb-uci, because it may be
+ *                  consumed or modified by the HAL: responses to internal
+ *                  commands, GET_CAPS_INFO_RSP, ignored DBG notifications and
+ *                  messages with a skip_reporting rx handler.
+ *                  Fragments of any other message are reported as they
+ *                  arrive. pkt is the first fragment.
+ *
+ * Returns          true if the fragments must be held back.
+ *
+ ******************************************************************************/
+static bool phNxpUciHal_rx_needs_message(const UciPacketView& pkt)
+{
+  if (pkt.mt == UCI_MT_RSP &&
+      (nxpucihal_ctrl.hal_ext_enabled || pkt.is(UCI_MT_RSP, UCI_GID_CORE, UCI_MSG_CORE_GET_CAPS_INFO))) {
+    return true;
+  }
+  if (pkt.is(UCI_MT_NTF, UCI_GID_INTERNAL, UCI_EXT_PARAM_DBG_RFRAME_LOG_NTF)) {
+    return true;
+  }
+  return phNxpUciHal_rx_handler_consumes(pkt);
+}
 
-    phNxpUciHal_rx_handler_check(pInfo->wLength, pInfo->pBuff);
+/******************************************************************************
+ * Function         phNxpUciHal_rx_packet
+ *
+ * Description      Handles one UCI message received from UWBC: runs the rx
+ *                  handlers and the HAL extensions, wakes up the pending
+ *                  extension command and reports the message to libuwb-uci
+ *                  unless it has been consumed.
+ *                  pkt is the whole message, reassembled if it was
+ *                  fragmented, p_frags holds the packets as received which
+ *                  are the ones reported to libuwb-uci. p_frags is empty when
+ *                  the fragments have already been reported.
+ *
+ * Returns          void.
+ *
+ ******************************************************************************/
+static void phNxpUciHal_rx_packet(const UciPacketView& pkt,
+                                  const uint8_t *p_frags, size_t frags_len)
+{
+  // rx handlers can also drop the packet by setting isSkipPacket
+  nxpucihal_ctrl.isSkipPacket = 0;
+  bool skip_packet = phNxpUciHal_rx_handler_check(pkt);
+  skip_packet |= nxpucihal_ctrl.isSkipPacket;
+
+  // mapping device caps according to Fira 2.0
+  if (pkt.is(UCI_MT_RSP, UCI_GID_CORE, UCI_MSG_CORE_GET_CAPS_INFO)) {
+    skip_packet |= phNxpUciHal_handle_get_caps_info(pkt);
+  }
 
-    // mapping device caps according to Fira 2.0
-    if (mt == UCI_MT_RSP && gid == UCI_GID_CORE && oid == UCI_MSG_CORE_GET_CAPS_INFO) {
-      phNxpUciHal_handle_get_caps_info(nxpucihal_ctrl.rx_data_len, nxpucihal_ctrl.p_rx_data);
-    }
+  // phNxpUciHal_process_ext_cmd_rsp() is waiting for the response packet
+  // set this true to wake it up for other reasons
+  bool bWakeupExtCmd = (pkt.mt == UCI_MT_RSP);
+  if (bWakeupExtCmd && nxpucihal_ctrl.ext_cb_waiting) {
+    nxpucihal_ctrl.ext_cb_data.status = UWBSTATUS_SUCCESS;
+  }
 
-    // phNxpUciHal_process_ext_cmd_rsp() is waiting for the response packet
-    // set this true to wake it up for other reasons
-    bool bWakeupExtCmd = (mt == UCI_MT_RSP);
-    if (bWakeupExtCmd && nxpucihal_ctrl.ext_cb_waiting) {
-      nxpucihal_ctrl.ext_cb_data.status = UWBSTATUS_SUCCESS;
+  /* DBG packets not yet supported, just ignore them silently */
+  if (!skip_packet) {
+    if (pkt.is(UCI_MT_NTF, UCI_GID_INTERNAL, UCI_EXT_PARAM_DBG_RFRAME_LOG_NTF)) {
+      skip_packet = true;
     }
+  }
 
-    /* DBG packets not yet supported, just ignore them silently */
-    if (!nxpucihal_ctrl.isSkipPacket) {
-      if ((mt == UCI_MT_NTF) && (gid == UCI_GID_INTERNAL) &&
-          (oid == UCI_EXT_PARAM_DBG_RFRAME_LOG_NTF)) {
-        nxpucihal_ctrl.isSkipPacket = 1;
+  if (!skip_packet) {
+    if (!pkt.pbf && pkt.is(UCI_MT_NTF, UCI_GID_CORE, UCI_MSG_CORE_GENERIC_ERROR_NTF) &&
+        pkt.has_status()) {
+      if (pkt.status() == UCI_STATUS_COMMAND_RETRY) {
+        // Handle retransmissions
+        // TODO: Do not retransmit it when !nxpucihal_ctrl.hal_ext_enabled,
+        // Upper layer should take care of it.
+        nxpucihal_ctrl.ext_cb_data.status = UWBSTATUS_COMMAND_RETRANSMIT;
+        skip_packet = true;
+        bWakeupExtCmd = true;
       }
     }
+  }
+
+  // Check status code only for extension commands
+  if (!skip_packet) {
+    if (pkt.mt == UCI_MT_RSP) {
+      if (nxpucihal_ctrl.hal_ext_enabled) {
+        skip_packet = true;
 
-    if (!nxpucihal_ctrl.isSkipPacket) {
-      if (!pbf && mt == UCI_MT_NTF && gid == UCI_GID_CORE && oid == UCI_MSG_CORE_GENERIC_ERROR_NTF) {
-        uint8_t status_code = nxpucihal_ctrl.p_rx_data[UCI_RESPONSE_STATUS_OFFSET];
-
-        if (status_code == UCI_STATUS_COMMAND_RETRY) {
-          // Handle retransmissions
-          // TODO: Do not retransmit it when !nxpucihal_ctrl.hal_ext_enabled,
-          // Upper layer should take care of it.
-          nxpucihal_ctrl.ext_cb_data.status = UWBSTATUS_COMMAND_RETRANSMIT;
-          nxpucihal_ctrl.isSkipPacket = 1;
-          bWakeupExtCmd = true;
+        // Keep the response for asynchronous command callers
+        if (pkt.len <= sizeof(nxpucihal_ctrl.p_rsp_data)) {
+          memcpy(nxpucihal_ctrl.p_rsp_data, pkt.data, pkt.len);
+          nxpucihal_ctrl.rsp_len = pkt.len;
+        }
+
+        uint8_t status_code = pkt.has_status() ? pkt.status() : UCI_STATUS_UNKNOWN;
+
+        if (status_code == UCI_STATUS_OK) {
+          nxpucihal_ctrl.ext_cb_data.status = UWBSTATUS_SUCCESS;
+        } else if ((pkt.gid == UCI_GID_CORE) && (pkt.oid == UCI_MSG_CORE_SET_CONFIG)){
+          /* check if any configurations are not supported then ignore the
+            * UWBSTATUS_FEATURE_NOT_SUPPORTED status code*/
+          nxpucihal_ctrl.ext_cb_data.status = phNxpUciHal_process_ext_rsp(pkt.len, pkt.data);
+        } else {
+          nxpucihal_ctrl.ext_cb_data.status = UWBSTATUS_FAILED;
+          NXPLOG_UCIHAL_E("Got error status code(0x%x) from internal command.", status_code);
+          usleep(1);  // XXX: not sure if it's really needed
         }
       }
     }
+  }
 
-    // Check status code only for extension commands
-    if (!nxpucihal_ctrl.isSkipPacket) {
-      if (mt == UCI_MT_RSP) {
-        if (nxpucihal_ctrl.hal_ext_enabled) {
-          nxpucihal_ctrl.isSkipPacket = 1;
+  if (bWakeupExtCmd && nxpucihal_ctrl.ext_cb_waiting) {
+    SEM_POST(&(nxpucihal_ctrl.ext_cb_data));
+  }
 
-          if (pbf) {
-            /* XXX: fix the whole logic if this really happens */
-            NXPLOG_UCIHAL_E("FIXME: Fragmented packets received while processing internal commands!");
-          }
+  if (!skip_packet) {
+    /* Read successful, send the event to higher layer */
+    phNxpUciHal_report_packets(p_frags, frags_len);
+  }
 
-          uint8_t status_code = (nxpucihal_ctrl.rx_data_len > UCI_RESPONSE_STATUS_OFFSET) ?
-            nxpucihal_ctrl.p_rx_data[UCI_RESPONSE_STATUS_OFFSET] : UCI_STATUS_UNKNOWN;
-
-          if (status_code == UCI_STATUS_OK) {
-            nxpucihal_ctrl.ext_cb_data.status = UWBSTATUS_SUCCESS;
-          } else if ((gid == UCI_GID_CORE) && (oid == UCI_MSG_CORE_SET_CONFIG)){
-            /* check if any configurations are not supported then ignore the
-              * UWBSTATUS_FEATURE_NOT_SUPPORTED status code*/
-            nxpucihal_ctrl.ext_cb_data.status = phNxpUciHal_process_ext_rsp(nxpucihal_ctrl.rx_data_len, nxpucihal_ctrl.p_rx_data);
-          } else {
-            nxpucihal_ctrl.ext_cb_data.status = UWBSTATUS_FAILED;
-            NXPLOG_UCIHAL_E("Got error status code(0x%x) from internal command.", status_code);
-            usleep(1);  // XXX: not sure if it's really needed
-          }
-        }
-      }
+  /* Disable junk data check for each UCI packet*/
+  if(nxpucihal_ctrl.fw_dwnld_mode) {
+    if((pkt.gid == UCI_GID_CORE) && (pkt.oid == UCI_MSG_CORE_DEVICE_STATUS_NTF)){
+      nxpucihal_ctrl.fw_dwnld_mode = false;
     }
+  }
+}
 
-    if (bWakeupExtCmd && nxpucihal_ctrl.ext_cb_waiting) {
-      SEM_POST(&(nxpucihal_ctrl.ext_cb_data));
-    }
+/******************************************************************************
+ * Function         phNxpUciHal_read_complete
+ *
+ * Description      This function is called whenever there is an UCI packet
+ *                  received from UWBC. It could be RSP or NTF packet. This
+ *                  function provide the received UCI packet to libuwb-uci
+ *                  using data callback of libuwb-uci.
+ *                  There is a pending read called from each
+ *                  phNxpUciHal_read_complete so each a packet received from
+ *                  UWBC can be provide to libuwb-uci.
+ *                  The header of each packet of the buffer is parsed once
+ *                  into an UciPacketView, fragments are reassembled and
+ *                  whole messages are handled by phNxpUciHal_rx_packet().
+ *                  Fragments of messages the HAL doesn't consume are
+ *                  reported as they arrive, see phNxpUciHal_rx_needs_message().
+ *
+ * Returns          void.
+ *
+ ******************************************************************************/
+void phNxpUciHal_read_complete(void* pContext, phTmlUwb_TransactInfo_t* pInfo)
+{
+  UNUSED(pContext);
 
-    if (!nxpucihal_ctrl.isSkipPacket) {
-      /* Read successful, send the event to higher layer */
-      if ((nxpucihal_ctrl.p_uwb_stack_data_cback != NULL) && (nxpucihal_ctrl.rx_data_len <= UCI_MAX_PAYLOAD_LEN)) {
-        (*nxpucihal_ctrl.p_uwb_stack_data_cback)(nxpucihal_ctrl.rx_data_len, nxpucihal_ctrl.p_rx_data);
-      }
+  if (pInfo->wStatus != UWBSTATUS_SUCCESS) {
+    NXPLOG_UCIHAL_E("read error status = 0x%x", pInfo->wStatus);
+    return;
+  }
+
+  NXPLOG_UCIHAL_D("read successful status = 0x%x", pInfo->wStatus);
+
+  const uint8_t *p = pInfo->pBuff;
+  size_t remaining = pInfo->wLength;
+  UciPacketView pkt;
+
+  while (remaining > 0) {
+    if (!UciPacketView::parse(p, remaining, &pkt)) {
+      NXPLOG_UCIHAL_E("Dropping truncated UCI packet, %zu bytes left", remaining);
+      break;
+    }
+    p += pkt.len;
+    remaining -= pkt.len;
+
+    NXPLOG_UCIHAL_V("read successful length = %zu", pkt.len);
+    phNxpUciHal_print_packet(NXP_TML_UCI_RSP_NTF_UWBS_2_AP, pkt.data, pkt.len);
+
+    // Fragments of a message the HAL doesn't need to see whole go up right
+    // away, only the internal copy is reassembled
+    bool first = !rx_reassembler.in_progress(pkt);
+    if (first && pkt.pbf) {
+      rx_streaming[pkt.mt & 0x07] = !phNxpUciHal_rx_needs_message(pkt);
+    } else if (first) {
+      rx_streaming[pkt.mt & 0x07] = false;
+    }
+    bool streaming = rx_streaming[pkt.mt & 0x07];
+    if (streaming) {
+      phNxpUciHal_report_packets(pkt.data, pkt.len);
     }
 
-    /* Disable junk data check for each UCI packet*/
-    if(nxpucihal_ctrl.fw_dwnld_mode) {
-      if((gid == UCI_GID_CORE) && (oid == UCI_MSG_CORE_DEVICE_STATUS_NTF)){
-        nxpucihal_ctrl.fw_dwnld_mode = false;
+    UciPacketView msg;
+    size_t nr_dropped = rx_reassembler.dropped();
+    auto result = rx_reassembler.push(pkt, &msg, !streaming);
+    if (rx_reassembler.dropped() != nr_dropped) {
+      if (result == UciReassembler::Result::DROPPED && streaming) {
+        NXPLOG_UCIHAL_E("UCI message mt=%u gid=0x%x oid=0x%x over %d bytes, reported but not handled",
+                        pkt.mt, pkt.gid, pkt.oid, UCI_MAX_REASSEMBLED_LEN);
+      } else {
+        NXPLOG_UCIHAL_E("Dropped fragmented UCI message before mt=%u gid=0x%x oid=0x%x",
+                        pkt.mt, pkt.gid, pkt.oid);
       }
     }
-    index += length;
-  } //End of loop
+    if (result == UciReassembler::Result::MESSAGE) {
+      phNxpUciHal_rx_packet(msg, rx_reassembler.fragments(msg.mt),
+                            rx_reassembler.fragments_len(msg.mt));
+    }
+  }
 }
 
 /******************************************************************************
@@ -619,17 +1055,35 @@ tHAL_UWB_STATUS phNxpUciHal_close() {
 
   uwb_device_initialized = false;
 
+  // Flush queued async commands before taking the lock they need
+  phNxpUciHal_cmd_engine_deinit();
+
   CONCURRENCY_LOCK();
 
   SessionTrack_deinit();
 
+  // Wait for the DATA write in flight, its completion still needs the
+  // client thread, and keep later ones away from TML
+  {
+    std::lock_guard<std::mutex> lock(data_tx_lock);
+    data_tx_closed = true;
+  }
+
   NXPLOG_UCIHAL_D("Terminating phNxpUciHal client thread...");
   phTmlUwb_DeferredCall(std::make_shared<phLibUwb_Message>(UCI_HAL_CLOSE_CPLT_MSG));
   nxpucihal_ctrl.client_thread.join();
 
+  // RspTimeout_deinit() and DataTxScheduler_deinit() log their statistics
+  phTmlUwb_Stats_SetDumpCb(NULL);
   status = phTmlUwb_Shutdown();
 
+  // No more RX dispatch, its rx handlers can go
+  DataTxScheduler_deinit();
+  RspTimeout_deinit();
+
   phNxpUciHal_rx_handler_destroy();
+  rx_reassembler.reset();
+  rx_streaming.fill(false);
 
   nxpucihal_ctrl.halStatus = HAL_STATUS_CLOSE;
 
@@ -641,6 +1095,8 @@ tHAL_UWB_STATUS phNxpUciHal_close() {
 
   phNxpUciHal_cleanup_monitor();
 
+  phOsalUwb_Thread_UnloadRtProfile();
+
   NxpConfig_Deinit();
 
   NXPLOG_UCIHAL_D("phNxpUciHal_close completed");
@@ -696,6 +1152,144 @@ static void parseAntennaConfig(const char *configName)
   }
 }
 
+//
+// VendorConfigCompiler
+//
+// Turns the vendor config blocks into the list of packets to send.
+//
+// CORE_SET_CONFIG blocks are parsed as TLV lists and consecutive ones are
+// merged into as few CORE_SET_CONFIG packets as the UCI control payload
+// allows. Any other command (or a block that doesn't parse) is sent as is
+// and keeps its place in the sequence. A parameter set again starts a new
+// packet, so the last value still wins.
+//
+// The source block of every parameter is kept to report which block a
+// failed parameter of a merged CORE_SET_CONFIG_RSP came from.
+//
+class VendorConfigCompiler {
+public:
+  struct Param {
+    uint16_t id;          // EXTENDED_DEVICE_CONFIG_ID << 8 | ext id, or id
+    const char *source;
+    bool mandatory;       // failure aborts phNxpUciHal_applyVendorConfig()
+  };
+  struct Packet {
+    std::vector<uint8_t> data;
+    std::vector<Param> params;  // empty for a packet sent as is
+    const char *source;         // packet sent as is
+    bool mandatory;
+  };
+
+  void Add(const char *source, const uint8_t *blob, size_t len, bool mandatory) {
+    nr_blocks_++;
+    if (!AddSetConfig(source, blob, len, mandatory)) {
+      Flush();
+      packets_.push_back(Packet{std::vector<uint8_t>(blob, blob + len), {}, source, mandatory});
+    }
+  }
+
+  std::vector<Packet> Finish() {
+    Flush();
+    NXPLOG_UCIHAL_D("VendorConfig: %zu blocks compiled into %zu commands", nr_blocks_, packets_.size());
+    nr_blocks_ = 0;
+    return std::move(packets_);
+  }
+
+  // Fills the ids and statuses of the parameters listed in a CORE_SET_CONFIG_RSP
+  static void ParseRsp(const uint8_t *rsp, size_t rsp_len,
+                       std::vector<std::pair<uint16_t, uint8_t>> *failed) {
+    size_t index = UCI_MSG_HDR_SIZE + 2;  // Status, number of params
+    while (index + 1 < rsp_len) {
+      uint16_t id = rsp[index++];
+      if (id == EXTENDED_DEVICE_CONFIG_ID) {
+        id = (id << 8) | rsp[index++];
+        if (index >= rsp_len)
+          break;
+      }
+      failed->emplace_back(id, rsp[index++]);
+    }
+  }
+
+private:
+  static constexpr size_t kMaxPayloadLen = 255;   // Control packet payload
+  static constexpr size_t kMaxNrParams = 255;
+
+  struct Tlv {
+    uint16_t id;
+    size_t offset;
+    size_t len;
+  };
+
+  std::vector<Packet> packets_;
+  std::vector<uint8_t> cur_tlvs_;
+  std::vector<Param> cur_params_;
+  size_t nr_blocks_ = 0;
+
+  static bool ParseSetConfig(const uint8_t *blob, size_t len, std::vector<Tlv> *tlvs) {
+    if (len < (UCI_MSG_HDR_SIZE + 1) ||
+        blob[0] != ((UCI_MT_CMD << UCI_MT_SHIFT) | UCI_GID_CORE) ||
+        blob[1] != UCI_MSG_CORE_SET_CONFIG ||
+        blob[UCI_PAYLOAD_LENGTH_OFFSET] != (len - UCI_MSG_HDR_SIZE)) {
+      return false;
+    }
+    size_t nr_params = blob[UCI_MSG_HDR_SIZE];
+    size_t index = UCI_MSG_HDR_SIZE + 1;
+    while (index < len) {
+      size_t offset = index;
+      uint16_t id = blob[index++];
+      if (id == EXTENDED_DEVICE_CONFIG_ID) {
+        if (index >= len)
+          return false;
+        id = (id << 8) | blob[index++];
+      }
+      if (index >= len)
+        return false;
+      index += 1 + blob[index];
+      if (index > len)
+        return false;
+      tlvs->push_back(Tlv{id, offset, index - offset});
+    }
+    return tlvs->size() == nr_params;
+  }
+
+  bool AddSetConfig(const char *source, const uint8_t *blob, size_t len, bool mandatory) {
+    std::vector<Tlv> tlvs;
+    if (!ParseSetConfig(blob, len, &tlvs)) {
+      return false;
+    }
+    for (const auto &tlv : tlvs) {
+      bool duplicated = std::any_of(cur_params_.begin(), cur_params_.end(),
+        [&tlv](const Param &param) { return param.id == tlv.id; });
+      if (duplicated || (1 + cur_tlvs_.size() + tlv.len) > kMaxPayloadLen ||
+          cur_params_.size() >= kMaxNrParams) {
+        Flush();
+      }
+      cur_tlvs_.insert(cur_tlvs_.end(), blob + tlv.offset, blob + tlv.offset + tlv.len);
+      cur_params_.push_back(Param{tlv.id, source, mandatory});
+    }
+    return true;
+  }
+
+  void Flush() {
+    if (cur_params_.empty()) {
+      return;
+    }
+    Packet packet;
+    packet.data = {
+      (UCI_MT_CMD << UCI_MT_SHIFT) | UCI_GID_CORE, UCI_MSG_CORE_SET_CONFIG, 0x00,
+      static_cast<uint8_t>(1 + cur_tlvs_.size()), static_cast<uint8_t>(cur_params_.size())
+    };
+    packet.data.insert(packet.data.end(), cur_tlvs_.begin(), cur_tlvs_.end());
+    packet.params = std::move(cur_params_);
+    packet.source = "CORE_SET_CONFIG";
+    packet.mandatory = std::any_of(packet.params.begin(), packet.params.end(),
+      [](const Param &param) { return param.mandatory; });
+    packets_.push_back(std::move(packet));
+    cur_tlvs_.clear();
+    cur_params_.clear();
+  }
+};
+
 /******************************************************************************
  * Function         phNxpUciHal_applyVendorConfig
  *
@@ -707,6 +1301,7 @@ static void parseAntennaConfig(const char *configName)
 tHAL_UWB_STATUS phNxpUciHal_applyVendorConfig()
 {
   std::vector<const char*> vendorParamNames;
+  VendorConfigCompiler compiler;
 
   // Base parameter names
   if (nxpucihal_ctrl.fw_boot_mode == USER_FW_BOOT_MODE) {
@@ -739,37 +1334,62 @@ tHAL_UWB_STATUS phNxpUciHal_applyVendorConfig()
   vendorParamNames.push_back(NAME_NXP_CORE_CONF_BLK "9");
   vendorParamNames.push_back(NAME_NXP_CORE_CONF_BLK "10");
 
-  // Execute
+  // Compile
   for (const auto paramName : vendorParamNames) {
     std::array<uint8_t, NXP_MAX_CONFIG_STRING_LEN> buffer;
     long retlen = 0;
     if (NxpConfig_GetByteArray(paramName, buffer.data(), buffer.size(), &retlen)) {
       if (retlen > 0 && retlen < UCI_MAX_DATA_LEN) {
-        NXPLOG_UCIHAL_D("VendorConfig: apply %s", paramName);
-        tHAL_UWB_STATUS status = phNxpUciHal_send_ext_cmd(retlen, buffer.data());
-        if (status != UWBSTATUS_SUCCESS) {
-          NXPLOG_UCIHAL_E("VendorConfig: failed to apply %s", paramName);
-          return status;
-        }
+        compiler.Add(paramName, buffer.data(), retlen, true);
       }
     }
   }
 
-  // Low Power Mode
+  // Low Power Mode, a failure is not fatal
   // TODO: remove this out, this can be move to Chip parameter names
   uint8_t lowPowerMode = 0;
   if (NxpConfig_GetNum(NAME_NXP_UWB_LOW_POWER_MODE, &lowPowerMode, sizeof(lowPowerMode))) {
-    NXPLOG_UCIHAL_D("VendorConfig: apply %s", NAME_NXP_UWB_LOW_POWER_MODE);
-
     // Core set config packet: GID=0x00 OID=0x04
     const std::vector<uint8_t> packet(
         {((UCI_MT_CMD << UCI_MT_SHIFT) | UCI_GID_CORE), UCI_MSG_CORE_SET_CONFIG,
          0x00, 0x04, 0x01, LOW_POWER_MODE_TAG_ID, LOW_POWER_MODE_LENGTH,
          lowPowerMode});
+    compiler.Add(NAME_NXP_UWB_LOW_POWER_MODE, packet.data(), packet.size(), false);
+  }
+
+  // Execute
+  for (const auto &packet : compiler.Finish()) {
+    NXPLOG_UCIHAL_D("VendorConfig: apply %s (%zu params)", packet.source, packet.params.size());
+    tHAL_UWB_STATUS status = phNxpUciHal_send_ext_cmd(packet.data.size(), packet.data.data());
+    if (status == UWBSTATUS_SUCCESS) {
+      continue;
+    }
 
-    if (phNxpUciHal_send_ext_cmd(packet.size(), packet.data()) != UWBSTATUS_SUCCESS) {
-      NXPLOG_UCIHAL_E("VendorConfig: failed to apply NAME_NXP_UWB_LOW_POWER_MODE");
+    bool mandatory = packet.mandatory;
+    if (!packet.params.empty() && nxpucihal_ctrl.rsp_len > 0) {
+      // Report the failed parameters with the block they came from
+      std::vector<std::pair<uint16_t, uint8_t>> failed;
+      VendorConfigCompiler::ParseRsp(nxpucihal_ctrl.p_rsp_data, nxpucihal_ctrl.rsp_len, &failed);
+      if (!failed.empty()) {
+        mandatory = false;
+      }
+      for (const auto &[id, id_status] : failed) {
+        auto it = std::find_if(packet.params.begin(), packet.params.end(),
+          [id](const VendorConfigCompiler::Param &param) { return param.id == id; });
+        if (it == packet.params.end()) {
+          NXPLOG_UCIHAL_E("VendorConfig: unknown param 0x%x failed, status 0x%x", id, id_status);
+          mandatory = packet.mandatory;
+          continue;
+        }
+        NXPLOG_UCIHAL_E("VendorConfig: %s param 0x%x failed, status 0x%x", it->source, id, id_status);
+        mandatory |= it->mandatory;
+      }
+    }
+    if (mandatory) {
+      NXPLOG_UCIHAL_E("VendorConfig: failed to apply %s", packet.source);
+      return status;
     }
+    NXPLOG_UCIHAL_E("VendorConfig: failed to apply optional params of %s", packet.source);
   }
 
   return UWBSTATUS_SUCCESS;
@@ -892,7 +1512,7 @@ tHAL_UWB_STATUS phNxpUciHal_init_hw()
                                       true, dev_status_ntf_cb);
 
   // Initiate UCI packet read
-  status = phTmlUwb_StartRead( Rx_data, UCI_MAX_DATA_LEN,
+  status = phTmlUwb_StartRead(UCI_MAX_DATA_LEN,
             (pphTmlUwb_TransactCompletionCb_t)&phNxpUciHal_read_complete, NULL);
   if (status != UWBSTATUS_SUCCESS) {
     NXPLOG_UCIHAL_E("read status error status = %x", status);
@@ -1101,7 +1721,6 @@ void phNxpUciHal_getVersionInfo() {
 void phNxpUciHal_send_dev_error_status_ntf()
 {
  NXPLOG_UCIHAL_D("phNxpUciHal_send_dev_error_status_ntf ");
- nxpucihal_ctrl.rx_data_len = 5;
  static uint8_t rsp_data[5] = {0x60, 0x01, 0x00, 0x01, 0xFF};
- (*nxpucihal_ctrl.p_uwb_stack_data_cback)(nxpucihal_ctrl.rx_data_len, rsp_data);
+ (*nxpucihal_ctrl.p_uwb_stack_data_cback)(sizeof(rsp_data), rsp_data);
 }
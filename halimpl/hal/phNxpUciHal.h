@@ -22,6 +22,7 @@
 #include "hal_nxpuwb.h"
 #include "NxpUwbChip.h"
 #include "phNxpUciHal_Adaptation.h"
+#include "phNxpUciHal_packet.h"
 #include "phNxpUciHal_utils.h"
 #include "phTmlUwb.h"
 #include "uci_defs.h"
@@ -30,6 +31,7 @@
 #define MAX_RETRY_COUNT 0x05
 #define UCI_MAX_DATA_LEN 4200 // maximum data packet size
 #define UCI_MAX_PAYLOAD_LEN 4200
+#define UCI_MAX_REASSEMBLED_LEN (16 * 1024) // largest fragmented message reassembled for the HAL
 // #define UCI_RESPONSE_STATUS_OFFSET 0x04
 #define UCI_PKT_HDR_LEN 0x04
 #define UCI_PKT_PAYLOAD_STATUS_LEN 0x01
@@ -166,10 +168,6 @@ typedef struct phNxpUciHal_Control {
 
   std::unique_ptr<NxpUwbChip> uwb_chip;
 
-  /* Rx data */
-  uint8_t* p_rx_data;
-  uint16_t rx_data_len;
-
   /* libuwb-uci callbacks */
   uwb_stack_callback_t* p_uwb_stack_cback;
   uwb_stack_data_callback_t* p_uwb_stack_data_cback;
@@ -181,8 +179,8 @@ typedef struct phNxpUciHal_Control {
   /* Waiting semaphore */
   phNxpUciHal_Sem_t ext_cb_data;
 
-  // in case of fragmented response,
-  // ext_cb_data is flagged only from the 1st response packet
+  // fragmented responses are reassembled first,
+  // ext_cb_data is flagged once from the whole response
   bool ext_cb_waiting;
 
   uint16_t cmd_len;
@@ -198,7 +196,7 @@ typedef struct phNxpUciHal_Control {
   device_type_t device_type;
   uint8_t fw_boot_mode;
 
-  /* To skip sending packets to upper layer from HAL*/
+  /* Set by rx handlers to skip sending the packet being handled to upper layer */
   uint8_t isSkipPacket;
   bool_t fw_dwnld_mode;
 
@@ -223,6 +221,9 @@ struct phNxpUciHal_RxHandler;
 #define UCI_HAL_INIT_CPLT_MSG 0x413
 #define UCI_HAL_ERROR_MSG 0x415
 
+/* Messages fetched per wakeup in burst drain mode */
+#define UCI_HAL_CLIENT_BURST_MAX 16
+
 #define UCIHAL_CMD_CODE_LEN_BYTE_OFFSET (2U)
 #define UCIHAL_CMD_CODE_BYTE_LEN (3U)
 
@@ -237,12 +238,16 @@ struct phNxpUciHal_RxHandler;
 /******************** UCI HAL exposed functions *******************************/
 tHAL_UWB_STATUS phNxpUciHal_init_hw();
 tHAL_UWB_STATUS phNxpUciHal_write_unlocked(uint16_t data_len, const uint8_t *p_data);
+uint16_t phNxpUciHal_write_data(uint16_t data_len, const uint8_t *p_data);
 void phNxpUciHal_read_complete(void* pContext, phTmlUwb_TransactInfo_t* pInfo);
 tHAL_UWB_STATUS phNxpUciHal_uwb_reset();
 tHAL_UWB_STATUS phNxpUciHal_applyVendorConfig();
 tHAL_UWB_STATUS phNxpUciHal_process_ext_cmd_rsp(uint16_t cmd_len, const uint8_t *p_cmd, uint16_t *data_written);
 void phNxpUciHal_send_dev_error_status_ntf();
 
+// Wildcard gid/oid for rx handlers, gid=UCI_HAL_RX_ANY matches any gid and oid
+#define UCI_HAL_RX_ANY 0xFF
+
 std::shared_ptr<phNxpUciHal_RxHandler> phNxpUciHal_rx_handler_add(
   uint8_t mt, uint8_t gid, uint8_t oid,
   bool skip_reporting, bool run_once,
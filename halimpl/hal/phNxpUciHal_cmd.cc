@@ -0,0 +1,166 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "phMessageQueue.h"
+#include "phNxpLog.h"
+#include "phNxpUciHal.h"
+#include "phNxpUciHal_cmd.h"
+#include "phNxpUciHal_utils.h"
+#include "phOsalUwb_Thread.h"
+
+extern phNxpUciHal_Control_t nxpucihal_ctrl;
+
+//
+// UciCmdEngine writes DATA packets without parking the caller's thread.
+//
+// Packets queued with phNxpUciHal_write_data_async() are written in
+// submission order by a single worker through phNxpUciHal_write_data(),
+// without CONCURRENCY_LOCK, so they keep flowing while a command waits for
+// its response. The worker thread is only started by the first packet, an
+// open that never queues one costs no thread.
+//
+class UciCmdEngine {
+private:
+  enum class UciCmdWorkType {
+    WRITE = 0,
+    STOP,
+  };
+  struct UciCmdMsg {
+    UciCmdWorkType type_;
+    std::vector<uint8_t> packet_;
+    phNxpUciHal_CmdCallback callback_;
+
+    UciCmdMsg(UciCmdWorkType type) : type_(type) { }
+    UciCmdMsg(UciCmdWorkType type, std::vector<uint8_t> packet, phNxpUciHal_CmdCallback callback) :
+      type_(type), packet_(std::move(packet)), callback_(std::move(callback)) { }
+  };
+
+  std::thread worker_thread_;
+  std::unique_ptr<MessageQueue<UciCmdMsg>> msgq_;
+
+public:
+  UciCmdEngine() { }
+
+  virtual ~UciCmdEngine() {
+    if (msgq_) {
+      msgq_->send(std::make_shared<UciCmdMsg>(UciCmdWorkType::STOP));
+    }
+    if (worker_thread_.joinable()) {
+      worker_thread_.join();
+    }
+  }
+
+  // gUciCmdEngineLock held
+  void QueueWrite(std::vector<uint8_t> packet, phNxpUciHal_CmdCallback callback) {
+    if (!msgq_) {
+      msgq_ = std::make_unique<MessageQueue<UciCmdMsg>>("UciData");
+      worker_thread_ = std::thread(&UciCmdEngine::CmdWorker, this);
+    }
+    msgq_->send(std::make_shared<UciCmdMsg>(UciCmdWorkType::WRITE, std::move(packet), std::move(callback)));
+  }
+
+private:
+  static void Complete(const std::shared_ptr<UciCmdMsg> &msg, phNxpUciHal_CmdResult result) {
+    if (msg->callback_) {
+      msg->callback_(result);
+    }
+  }
+
+  static phNxpUciHal_CmdResult RunWrite(const std::vector<uint8_t> &packet) {
+    phNxpUciHal_CmdResult result;
+    uint16_t len = phNxpUciHal_write_data(packet.size(), packet.data());
+
+    result.status = (len == packet.size()) ? UWBSTATUS_SUCCESS : UWBSTATUS_FAILED;
+    return result;
+  }
+
+  void CmdWorker() {
+    NXPLOG_UCIHAL_D("UciCmd: worker thread started.");
+
+    phOsalUwb_Thread_ApplyRtProfile(phOsalUwb_ThreadRole_t::DataTx);
+
+    bool stop_thread = false;
+    while (!stop_thread) {
+      auto msg = msgq_->recv();
+      if (!msg) {
+        NXPLOG_UCIHAL_E("UciCmd: worker thread received a bad message!, stop the queue");
+        break;
+      }
+
+      switch (msg->type_) {
+      case UciCmdWorkType::WRITE:
+        Complete(msg, RunWrite(msg->packet_));
+        break;
+      case UciCmdWorkType::STOP:
+        stop_thread = true;
+        break;
+      default:
+        NXPLOG_UCIHAL_E("UciCmd: worker thread received a bad message!");
+        break;
+      }
+    }
+
+    // Fail whatever was queued after STOP
+    std::shared_ptr<UciCmdMsg> msg;
+    while ((msg = msgq_->try_recv()) != nullptr) {
+      Complete(msg, phNxpUciHal_CmdResult{UWBSTATUS_SHUTDOWN});
+    }
+
+    NXPLOG_UCIHAL_D("UciCmd: worker thread exit.");
+  }
+};
+
+static std::unique_ptr<UciCmdEngine> gUciCmdEngine;
+static std::mutex gUciCmdEngineLock;
+
+void phNxpUciHal_cmd_engine_init()
+{
+  std::lock_guard<std::mutex> lock(gUciCmdEngineLock);
+  gUciCmdEngine = std::make_unique<UciCmdEngine>();
+}
+
+void phNxpUciHal_cmd_engine_deinit()
+{
+  std::unique_ptr<UciCmdEngine> engine;
+  {
+    std::lock_guard<std::mutex> lock(gUciCmdEngineLock);
+    engine = std::move(gUciCmdEngine);
+  }
+  // Packets queued so far are still written, later submissions fail
+  engine.reset();
+}
+
+tHAL_UWB_STATUS phNxpUciHal_write_data_async(uint16_t data_len, const uint8_t *p_data,
+                                             phNxpUciHal_CmdCallback callback)
+{
+  if (nxpucihal_ctrl.halStatus != HAL_STATUS_OPEN) {
+    return UWBSTATUS_FAILED;
+  }
+  if (data_len < UCI_MSG_HDR_SIZE || data_len > UCI_MAX_DATA_LEN ||
+      ((p_data[0] & UCI_MT_MASK) >> UCI_MT_SHIFT) != UCI_MT_DATA) {
+    return UWBSTATUS_INVALID_PARAMETER;
+  }
+
+  std::lock_guard<std::mutex> lock(gUciCmdEngineLock);
+  if (!gUciCmdEngine) {
+    return UWBSTATUS_FAILED;
+  }
+  gUciCmdEngine->QueueWrite(std::vector<uint8_t>(p_data, p_data + data_len), std::move(callback));
+  return UWBSTATUS_PENDING;
+}
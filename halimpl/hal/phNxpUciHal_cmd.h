@@ -0,0 +1,45 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PHNXPUCIHAL_CMD_H_
+#define _PHNXPUCIHAL_CMD_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "phUwbStatus.h"
+
+// Result of an asynchronous write
+struct phNxpUciHal_CmdResult {
+  tHAL_UWB_STATUS status;
+};
+
+// Completion callback, invoked on the command engine thread.
+using phNxpUciHal_CmdCallback = std::function<void(const phNxpUciHal_CmdResult &result)>;
+
+void phNxpUciHal_cmd_engine_init();
+void phNxpUciHal_cmd_engine_deinit();
+
+// Non-blocking variant of phNxpUciHal_write_data() for DATA packets, the
+// packet is copied. Packets are written in submission order, callback
+// (optional) only gets UWBSTATUS_SUCCESS once the whole packet was written.
+// SessionTrack is not refreshed: for packets the caller already accounted
+// for. Safe to call from rx handlers.
+tHAL_UWB_STATUS phNxpUciHal_write_data_async(uint16_t data_len, const uint8_t *p_data,
+                                             phNxpUciHal_CmdCallback callback);
+
+#endif
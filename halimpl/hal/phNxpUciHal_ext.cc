@@ -18,6 +18,7 @@
 
 #include <atomic>
 #include <bitset>
+#include <chrono>
 #include <map>
 #include <vector>
 
@@ -30,11 +31,9 @@
 #include "phNxpUciHal_utils.h"
 #include "phTmlUwb.h"
 #include "phUwbCommon.h"
+#include "rspTimeout.h"
 #include "sessionTrack.h"
 
-/* Timeout value to wait for response from DEVICE_TYPE_SR1xx */
-#define MAX_COMMAND_RETRY_COUNT           5
-#define HAL_EXTNS_WRITE_RSP_TIMEOUT_MS    100
 #define HAL_HW_RESET_NTF_TIMEOUT          10000 /* 10 sec wait */
 
 /******************* Global variables *****************************************/
@@ -82,15 +81,28 @@ tHAL_UWB_STATUS phNxpUciHal_process_ext_cmd_rsp(uint16_t cmd_len,
     return UWBSTATUS_FAILED;
   }
 
+  const uint8_t gid = p_cmd[0] & UCI_GID_MASK;
+  const uint8_t oid = p_cmd[1] & UCI_OID_MASK;
+  const int max_retries = RspTimeout_getMaxRetries();
   tHAL_UWB_STATUS status = UWBSTATUS_FAILED;
   int nr_retries = 0;
   int nr_timedout = 0;
   bool exit_loop = false;
+  bool gave_up = false;
+  std::chrono::steady_clock::time_point sent_at;
 
   while(!exit_loop) {
+    if (nr_retries > 0) {
+      // Bounded, slept with CONCURRENCY_LOCK held like the RSP wait
+      uint32_t backoff_ms = RspTimeout_getBackoff(nr_retries);
+      if (backoff_ms) {
+        usleep(backoff_ms * 1000);
+      }
+    }
     nxpucihal_ctrl.ext_cb_data.status = UWBSTATUS_FAILED;
     nxpucihal_ctrl.ext_cb_waiting = true;
 
+    sent_at = std::chrono::steady_clock::now();
     *data_written = phNxpUciHal_write_unlocked(cmd_len, p_cmd);
 
     if (*data_written != cmd_len) {
@@ -105,7 +117,8 @@ tHAL_UWB_STATUS phNxpUciHal_process_ext_cmd_rsp(uint16_t cmd_len,
     }
 
     // Wait for rsp
-    phNxpUciHal_sem_timed_wait_msec(&nxpucihal_ctrl.ext_cb_data, HAL_EXTNS_WRITE_RSP_TIMEOUT_MS);
+    phNxpUciHal_sem_timed_wait_msec(&nxpucihal_ctrl.ext_cb_data,
+                                    RspTimeout_get(gid, oid, nr_timedout));
 
     nxpucihal_ctrl.ext_cb_waiting = false;
 
@@ -124,10 +137,11 @@ tHAL_UWB_STATUS phNxpUciHal_process_ext_cmd_rsp(uint16_t cmd_len,
       break;
     }
 
-    if (nr_retries >= MAX_COMMAND_RETRY_COUNT) {
+    if (nr_retries >= max_retries) {
       NXPLOG_UCIHAL_E("Failed to process cmd/rsp 0x%x", nxpucihal_ctrl.ext_cb_data.status);
       status = UWBSTATUS_FAILED;
       exit_loop = true;
+      gave_up = true;
       phNxpUciHal_send_dev_error_status_ntf();
     }
   }
@@ -136,6 +150,8 @@ tHAL_UWB_STATUS phNxpUciHal_process_ext_cmd_rsp(uint16_t cmd_len,
     NXPLOG_UCIHAL_E("Warning: CMD/RSP retried %d times (timeout:%d)\n",
                     nr_retries, nr_timedout);
   }
+  RspTimeout_onCommand(gid, oid, nr_retries, nr_timedout, gave_up,
+    std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent_at).count());
 
 clean_and_return:
   phNxpUciHal_cleanup_cb_data(&nxpucihal_ctrl.ext_cb_data);
@@ -163,10 +179,8 @@ tHAL_UWB_STATUS phNxpUciHal_send_ext_cmd(uint16_t cmd_len, const uint8_t* p_cmd)
   }
   uint16_t data_written = 0;
   HAL_ENABLE_EXT();
-  nxpucihal_ctrl.cmd_len = cmd_len;
-  memcpy(nxpucihal_ctrl.p_cmd_data, p_cmd, cmd_len);
-  status = phNxpUciHal_process_ext_cmd_rsp(
-      nxpucihal_ctrl.cmd_len, nxpucihal_ctrl.p_cmd_data, &data_written);
+  nxpucihal_ctrl.rsp_len = 0;
+  status = phNxpUciHal_process_ext_cmd_rsp(cmd_len, p_cmd, &data_written);
   HAL_DISABLE_EXT();
 
   return status;
@@ -217,7 +231,7 @@ tHAL_UWB_STATUS phNxpUciHal_set_board_config(){
 ** Returns          UWBSTATUS_SUCCESS if success
 **
 *******************************************************************************/
-tHAL_UWB_STATUS phNxpUciHal_process_ext_rsp(uint16_t rsp_len, uint8_t* p_buff){
+tHAL_UWB_STATUS phNxpUciHal_process_ext_rsp(uint16_t rsp_len, const uint8_t* p_buff){
   tHAL_UWB_STATUS status;
   int NumOfTlv, index;
   uint8_t paramId, extParamId, IdStatus;
@@ -438,24 +452,25 @@ static bool CountryCodeCapsGenTxPowerPacket(uint8_t *packet, size_t packet_len,
  *
  * Description  Remembers SET_VENDOR_SET_CALIBRATION_CMD packet
  *
- * Returns      void
+ * Returns      true if the packet to send has been patched into
+ *              nxpucihal_ctrl.p_cmd_data/cmd_len
  *
  *******************************************************************************/
-void phNxpUciHal_handle_set_calibration(const uint8_t *p_data, uint16_t data_len)
+bool phNxpUciHal_handle_set_calibration(const uint8_t *p_data, uint16_t data_len)
 {
   // Only saves the SET_CALIBRATION_CMD from upper-layer
   if (nxpucihal_ctrl.hal_ext_enabled) {
-    return;
+    return false;
   }
 
   // SET_DEVICE_CALIBRATION_CMD Packet format: Channel(1) + TLV
   if (data_len < 6) {
-    return;
+    return false;
   }
   const uint8_t channel = p_data[UCI_MSG_HDR_SIZE + 0];
   const uint8_t tag = p_data[UCI_MSG_HDR_SIZE + 1];
   if (tag != NXP_PARAM_ID_TX_POWER_PER_ANTENNA) {
-    return;
+    return false;
   }
 
   phNxpUciHal_Runtime_Settings_t *rt_set = &nxpucihal_ctrl.rt_settings;
@@ -467,7 +482,7 @@ void phNxpUciHal_handle_set_calibration(const uint8_t *p_data, uint16_t data_len
   gtx_power = std::move(std::vector<uint8_t> {p_data, p_data + data_len});
 
   // Patch SET_CALIBRATION_CMD per gtx_power + tx_power_offset
-  CountryCodeCapsGenTxPowerPacket(nxpucihal_ctrl.p_cmd_data, sizeof(nxpucihal_ctrl.p_cmd_data), &nxpucihal_ctrl.cmd_len);
+  return CountryCodeCapsGenTxPowerPacket(nxpucihal_ctrl.p_cmd_data, sizeof(nxpucihal_ctrl.p_cmd_data), &nxpucihal_ctrl.cmd_len);
 }
 
 /******************************************************************************
@@ -789,14 +804,13 @@ void phNxpUciHal_handle_set_country_code(const char country_code[2])
   }
 
   // send country code response to upper layer
-  nxpucihal_ctrl.rx_data_len = 5;
   static uint8_t rsp_data[5] = { 0x4c, 0x01, 0x00, 0x01 };
   if (rt_set->uwb_enable) {
     rsp_data[4] = UWBSTATUS_SUCCESS;
   } else {
     rsp_data[4] = UCI_STATUS_CODE_ANDROID_REGULATION_UWB_OFF;
   }
-  (*nxpucihal_ctrl.p_uwb_stack_data_cback)(nxpucihal_ctrl.rx_data_len, rsp_data);
+  (*nxpucihal_ctrl.p_uwb_stack_data_cback)(sizeof(rsp_data), rsp_data);
 }
 
 // TODO: support fragmented packets
@@ -804,14 +818,18 @@ void phNxpUciHal_handle_set_country_code(const char country_code[2])
  * Function         phNxpUciHal_handle_set_app_config
  *
  * Description      Handle SESSION_SET_APP_CONFIG_CMD packet,
- *                  remove unsupported parameters
+ *                  remove unsupported parameters.
+ *                  The packet is only copied, to nxpucihal_ctrl.p_cmd_data,
+ *                  when parameters have to be removed, *pp_data and
+ *                  *data_len are then updated to the patched packet.
  *
  * Returns          true  : SESSION_SET_APP_CONFIG_CMD/RSP was handled by this function
  *                  false : This packet should go to chip
  *
  *************************************************************************************/
-bool phNxpUciHal_handle_set_app_config(uint16_t *data_len, uint8_t *p_data)
+bool phNxpUciHal_handle_set_app_config(uint16_t *data_len, const uint8_t **pp_data)
 {
+  const uint8_t *p_data = *pp_data;
   const phNxpUciHal_Runtime_Settings_t *rt_set = &nxpucihal_ctrl.rt_settings;
   // Android vendor specific app configs not supported by FW
   const uint8_t tags_to_del[] = {
@@ -835,17 +853,17 @@ bool phNxpUciHal_handle_set_app_config(uint16_t *data_len, uint8_t *p_data)
   uint32_t session_handle = le_bytes_to_cpu<uint32_t>(&p_data[UCI_MSG_SESSION_SET_APP_CONFIG_HANDLE_OFFSET]);
   uint8_t ch = 0;
 
-  // Create local copy of cmd_data for data manipulation
-  uint8_t uciCmd[UCI_MAX_DATA_LEN];
+  // Patched packet, only created once a parameter has to be removed
+  uint8_t *uciCmd = NULL;
   uint16_t packet_len = *data_len;
-  if (sizeof(uciCmd) < packet_len) {
+  if (sizeof(nxpucihal_ctrl.p_cmd_data) < packet_len) {
     NXPLOG_UCIHAL_E("SESSION_SET_APP_CONFIG_CMD packet size %u is too big to handle, skip patching.", packet_len);
     return false;
   }
   // 9 = Header 4 + SessionID 4 + NumOfConfigs 1
-  uint8_t i = 9, j = 9;
-  uint8_t nr_deleted = 0, bytes_deleted = 0;
-  memcpy(uciCmd, p_data, i);
+  uint16_t i = 9, j = 9;
+  uint8_t nr_deleted = 0;
+  uint16_t bytes_deleted = 0;
 
   while (i < packet_len) {
     if ( (i + 2) >= packet_len) {
@@ -856,9 +874,10 @@ bool phNxpUciHal_handle_set_app_config(uint16_t *data_len, uint8_t *p_data)
     // All parameters should have 1 byte tag
     uint8_t tlv_tag = p_data[i + 0];
     uint8_t tlv_len = p_data[i + 1];
-    uint8_t param_len = 2 + tlv_len;
+    uint16_t param_len = 2 + tlv_len;
     if ((i + param_len) > packet_len) {
       NXPLOG_UCIHAL_E("SESSION_SET_APP_CONFIG_CMD parse error at %u", i);
+      return false;
     }
 
     // check restricted channel
@@ -874,18 +893,23 @@ bool phNxpUciHal_handle_set_app_config(uint16_t *data_len, uint8_t *p_data)
         static uint8_t rsp_data[] = { 0x41, 0x03, 0x04, 0x04,
           UCI_STATUS_FAILED, 0x01, tlv_tag, UCI_STATUS_CODE_ANDROID_REGULATION_UWB_OFF
         };
-        nxpucihal_ctrl.rx_data_len = sizeof(rsp_data);
-        (*nxpucihal_ctrl.p_uwb_stack_data_cback)(nxpucihal_ctrl.rx_data_len, rsp_data);
+        (*nxpucihal_ctrl.p_uwb_stack_data_cback)(sizeof(rsp_data), rsp_data);
         return true;
       }
     }
 
     // remove unsupported parameters
     if (std::find(std::begin(tags_to_del), std::end(tags_to_del), tlv_tag) == std::end(tags_to_del)) {
-      memcpy(&uciCmd[j], &p_data[i], param_len);
+      if (uciCmd) {
+        memmove(&uciCmd[j], &p_data[i], param_len);
+      }
       j += param_len;
     } else {
       NXPLOG_UCIHAL_D("Removed param payload with Tag ID:0x%02x", tlv_tag);
+      if (!uciCmd) {
+        uciCmd = nxpucihal_ctrl.p_cmd_data;
+        memmove(uciCmd, p_data, j);
+      }
       nr_deleted++;
       bytes_deleted += param_len;
     }
@@ -911,8 +935,9 @@ bool phNxpUciHal_handle_set_app_config(uint16_t *data_len, uint8_t *p_data)
     uciCmd[UCI_CMD_LENGTH_PARAM_BYTE2] = (payload_len & 0xFF00) >> 8;
     uciCmd[UCI_CMD_LENGTH_PARAM_BYTE1] = (payload_len & 0xFF);
 
-    // Swap
-    memcpy(p_data, uciCmd, packet_len);
+    // Send the patched packet instead
+    nxpucihal_ctrl.cmd_len = packet_len;
+    *pp_data = uciCmd;
     *data_len = packet_len;
   }
 
@@ -921,15 +946,18 @@ bool phNxpUciHal_handle_set_app_config(uint16_t *data_len, uint8_t *p_data)
   return false;
 }
 
-void phNxpUciHal_handle_get_caps_info(uint16_t data_len, uint8_t *p_data)
+bool phNxpUciHal_handle_get_caps_info(const UciPacketView& pkt)
 {
-  if (data_len < UCI_MSG_CORE_GET_CAPS_INFO_NR_OFFSET)
-    return;
+  const size_t data_len = pkt.len;
+  const uint8_t *p_data = pkt.data;
+
+  if (data_len <= UCI_MSG_CORE_GET_CAPS_INFO_NR_OFFSET)
+    return false;
 
-  uint8_t status = p_data[UCI_RESPONSE_STATUS_OFFSET];
+  uint8_t status = pkt.status();
   uint8_t nr = p_data[UCI_MSG_CORE_GET_CAPS_INFO_NR_OFFSET];
   if (status != UWBSTATUS_SUCCESS || nr < 1)
-    return;
+    return false;
 
   auto tlvs = decodeTlvBytes({0xe0, 0xe1, 0xe2, 0xe3}, &p_data[UCI_MSG_CORE_GET_CAPS_INFO_TLV_OFFSET], data_len - UCI_MSG_CORE_GET_CAPS_INFO_TLV_OFFSET);
   if (tlvs.size() != nr) {
@@ -1007,6 +1035,7 @@ void phNxpUciHal_handle_get_caps_info(uint16_t data_len, uint8_t *p_data)
   auto tlv_bytes = encodeTlvBytes(tlvs);
   if ((tlv_bytes.size() + UCI_MSG_CORE_GET_CAPS_INFO_TLV_OFFSET) > sizeof(packet)) {
     NXPLOG_UCIHAL_E("DevCaps overflow!");
+    return false;
   } else {
     uint8_t packet_len = UCI_MSG_CORE_GET_CAPS_INFO_TLV_OFFSET + tlv_bytes.size();
     packet[UCI_PAYLOAD_LENGTH_OFFSET] = packet_len - UCI_MSG_HDR_SIZE;
@@ -1018,6 +1047,6 @@ void phNxpUciHal_handle_get_caps_info(uint16_t data_len, uint8_t *p_data)
     (*nxpucihal_ctrl.p_uwb_stack_data_cback)(packet_len, packet);
     // skip the incoming packet as we have send the modified response
     // already
-    nxpucihal_ctrl.isSkipPacket = 1;
+    return true;
   }
 }
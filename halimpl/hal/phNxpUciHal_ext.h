@@ -58,13 +58,13 @@
 #define UCI_EXT_STATUS_SE_AUTH_FAIL         0x75
 
 tHAL_UWB_STATUS phNxpUciHal_send_ext_cmd(uint16_t cmd_len, const uint8_t* p_cmd);
-tHAL_UWB_STATUS phNxpUciHal_process_ext_rsp(uint16_t cmd_len, uint8_t* p_buff);
+tHAL_UWB_STATUS phNxpUciHal_process_ext_rsp(uint16_t cmd_len, const uint8_t* p_buff);
 tHAL_UWB_STATUS phNxpUciHal_set_board_config();
-void phNxpUciHal_handle_set_calibration(const uint8_t *p_data, uint16_t data_len);
+bool phNxpUciHal_handle_set_calibration(const uint8_t *p_data, uint16_t data_len);
 void phNxpUciHal_extcal_handle_coreinit(void);
 void phNxpUciHal_process_response();
 void phNxpUciHal_handle_set_country_code(const char country_code[2]);
-bool phNxpUciHal_handle_set_app_config(uint16_t *data_len, uint8_t *p_data);
-void phNxpUciHal_handle_get_caps_info(uint16_t data_len, uint8_t *p_data);
+bool phNxpUciHal_handle_set_app_config(uint16_t *data_len, const uint8_t **pp_data);
+bool phNxpUciHal_handle_get_caps_info(const UciPacketView& pkt);
 void apply_per_country_calibrations(void);
 #endif /* _PHNXPNICHAL_EXT_H_ */
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PHNXPUCIHAL_PACKET_H_
+#define _PHNXPUCIHAL_PACKET_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "uci_defs.h"
+
+// Extended payload length bit of octet 1
+#define UCI_EXT_LEN_INDICATOR 0x80
+
+// Parsed header of one UCI packet
+//
+// The view borrows the packet bytes, it is only valid as long as the buffer
+// it was parsed from (e.g. during the TML read callback).
+struct UciPacketView {
+  const uint8_t *data;      // Whole packet, header included
+  size_t len;               // UCI_MSG_HDR_SIZE + payload_len
+  const uint8_t *payload;
+  size_t payload_len;
+  uint8_t mt;
+  uint8_t pbf;
+  uint8_t gid;
+  uint8_t oid;
+  bool ext_len;             // 16-bit payload length (DATA or extended bit)
+
+  // Parses the packet at the beginning of buf, the packet may be followed by
+  // other ones. Returns false if buf doesn't hold a complete packet.
+  static bool parse(const uint8_t *buf, size_t buf_len, UciPacketView *view) {
+    if (buf_len < UCI_MSG_HDR_SIZE) {
+      return false;
+    }
+    view->mt = (buf[0] & UCI_MT_MASK) >> UCI_MT_SHIFT;
+    view->pbf = (buf[0] & UCI_PBF_MASK) >> UCI_PBF_SHIFT;
+    view->gid = buf[0] & UCI_GID_MASK;
+    view->oid = buf[1] & UCI_OID_MASK;
+    view->ext_len = (view->mt == UCI_MT_DATA) || (buf[1] & UCI_EXT_LEN_INDICATOR);
+    view->payload_len = buf[UCI_PAYLOAD_LENGTH_OFFSET];
+    if (view->ext_len) {
+      view->payload_len = (view->payload_len << 8) | buf[UCI_PAYLOAD_LENGTH_OFFSET - 1];
+    }
+    view->data = buf;
+    view->payload = buf + UCI_MSG_HDR_SIZE;
+    view->len = UCI_MSG_HDR_SIZE + view->payload_len;
+    return view->len <= buf_len;
+  }
+
+  bool is(uint8_t mt_, uint8_t gid_, uint8_t oid_) const {
+    return mt == mt_ && gid == gid_ && oid == oid_;
+  }
+
+  // First payload octet, the status of RSP and most NTF packets
+  bool has_status() const { return payload_len > 0; }
+  uint8_t status() const { return payload[0]; }
+};
+
+// Reassembles fragmented (PBF=1) UCI messages received from the UWBS
+//
+// One message per MT can be in progress, fragments of a message carry the
+// same MT/GID/OID and the last one has PBF=0. The payloads are gathered in a
+// single contiguous buffer behind a rebuilt header. When asked to on the first
+// fragment, the original fragments are also kept as received so they can be
+// forwarded unchanged once the message is complete. An unfragmented packet is
+// returned as is, without any copy.
+// Buffers are reused across messages and bounded by max_len.
+class UciReassembler {
+public:
+  enum class Result {
+    MESSAGE = 0,    // *msg holds a whole message
+    PENDING,        // fragment stored, more to come
+    DROPPED,        // last fragment of a message over max_len, message discarded
+  };
+
+  // True if pkt continues the message in progress for its MT
+  bool in_progress(const UciPacketView &pkt) const {
+    const Slot &slot = slots_[pkt.mt & 0x07];
+    return slot.active && !slot.complete && pkt.gid == slot.gid && pkt.oid == slot.oid;
+  }
+
+  explicit UciReassembler(size_t max_len) : max_len_(max_len) { }
+
+  // msg stays valid until the next push() of the same MT or reset().
+  // keep_fragments is only looked at on the first fragment of a message.
+  // fragments()/fragments_len() return the raw fragments of the last message,
+  // nothing for a fragmented message whose fragments weren't kept.
+  Result push(const UciPacketView &pkt, UciPacketView *msg, bool keep_fragments = true) {
+    Slot &slot = slots_[pkt.mt & 0x07];
+
+    if (slot.complete) {
+      slot.clear();
+    }
+
+    if (!slot.active && !pkt.pbf) {
+      slot.raw_ref = pkt.data;
+      slot.raw_ref_len = pkt.len;
+      *msg = pkt;
+      return Result::MESSAGE;
+    }
+
+    if (slot.active && (pkt.gid != slot.gid || pkt.oid != slot.oid)) {
+      // Previous message never got its last fragment
+      slot.clear();
+      nr_dropped_++;
+    }
+    if (!slot.active) {
+      slot.active = true;
+      slot.gid = pkt.gid;
+      slot.oid = pkt.oid;
+      slot.hdr0 = pkt.data[0] & ~UCI_PBF_MASK;
+      slot.hdr1 = (pkt.mt == UCI_MT_DATA) ? pkt.data[1] : (pkt.data[1] & ~UCI_EXT_LEN_INDICATOR);
+      slot.keep_raw = keep_fragments;
+      slot.msg.assign(UCI_MSG_HDR_SIZE, 0);
+    }
+
+    if (!slot.overflow) {
+      if (slot.msg.size() + pkt.payload_len > max_len_) {
+        slot.overflow = true;
+        slot.msg.clear();
+        slot.raw.clear();
+      } else {
+        slot.msg.insert(slot.msg.end(), pkt.payload, pkt.payload + pkt.payload_len);
+        if (slot.keep_raw) {
+          slot.raw.insert(slot.raw.end(), pkt.data, pkt.data + pkt.len);
+        }
+      }
+    }
+
+    if (pkt.pbf) {
+      return Result::PENDING;
+    }
+
+    // Last fragment
+    if (slot.overflow) {
+      slot.clear();
+      nr_dropped_++;
+      return Result::DROPPED;
+    }
+
+    size_t payload_len = slot.msg.size() - UCI_MSG_HDR_SIZE;
+    bool is_data = (pkt.mt == UCI_MT_DATA);
+    bool ext_len = is_data || (payload_len > 0xFF);
+    slot.msg[0] = slot.hdr0;
+    slot.msg[1] = slot.hdr1 | ((ext_len && !is_data) ? UCI_EXT_LEN_INDICATOR : 0);
+    slot.msg[2] = ext_len ? (payload_len & 0xFF) : 0;
+    slot.msg[3] = ext_len ? ((payload_len >> 8) & 0xFF) : payload_len;
+    slot.complete = true;
+    slot.raw_ref = slot.raw.data();
+    slot.raw_ref_len = slot.raw.size();
+
+    UciPacketView::parse(slot.msg.data(), slot.msg.size(), msg);
+    return Result::MESSAGE;
+  }
+
+  // Messages discarded so far
+  size_t dropped() const { return nr_dropped_; }
+
+  const uint8_t *fragments(uint8_t mt) const { return slots_[mt & 0x07].raw_ref; }
+  size_t fragments_len(uint8_t mt) const { return slots_[mt & 0x07].raw_ref_len; }
+
+  void reset() {
+    for (auto &slot : slots_) {
+      slot.clear();
+    }
+  }
+
+private:
+  struct Slot {
+    bool active = false;
+    bool complete = false;
+    bool overflow = false;
+    bool keep_raw = true;
+    uint8_t gid = 0;
+    uint8_t oid = 0;
+    uint8_t hdr0 = 0;
+    uint8_t hdr1 = 0;
+    std::vector<uint8_t> msg;   // Rebuilt header + payloads
+    std::vector<uint8_t> raw;   // Fragments as received
+    const uint8_t *raw_ref = nullptr;
+    size_t raw_ref_len = 0;
+
+    void clear() {
+      active = complete = overflow = false;
+      msg.clear();
+      raw.clear();
+      raw_ref = nullptr;
+      raw_ref_len = 0;
+    }
+  };
+
+  size_t max_len_;
+  size_t nr_dropped_ = 0;
+  std::array<Slot, 8> slots_;
+};
+
+#endif
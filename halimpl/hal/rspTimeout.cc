@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "phNxpConfig.h"
+#include "phNxpLog.h"
+#include "phNxpUciHal.h"
+#include "phNxpUciHal_ext.h"
+#include "rspTimeout.h"
+#include "uci_defs.h"
+
+//
+// RspTimeout
+//
+// Response timeout and retry policy of phNxpUciHal_process_ext_cmd_rsp().
+//
+// 1. Per-opcode timeouts
+//
+// Every (gid, oid) waits UWB_RSP_TIMEOUT_MS for its RSP unless it has its
+// own entry: a few slow commands have built-in defaults, and
+// UWB_RSP_TIMEOUT_TABLE overrides or adds entries.
+//
+// 2. Adaptive timeouts (optional, UWB_RSP_TIMEOUT_ADAPTIVE=1)
+//
+// The CMD to RSP latency of each opcode is smoothed as TCP does for its RTO
+// (srtt += (sample - srtt) / 8, rttvar += (|sample - srtt| - rttvar) / 4),
+// and the timeout becomes srtt + 4 * rttvar, bounded by UWB_RSP_TIMEOUT_MIN_MS
+// and the configured timeout of the opcode. Retransmitted commands give no
+// sample since the RSP can't be matched to an attempt.
+// Each timed out attempt doubles the timeout of the next one, up to the
+// configured timeout, so a command never waits longer than it used to.
+//
+// 3. Retry backoff
+//
+// The n-th retransmission waits UWB_CMD_RETRY_BACKOFF_MS << (n - 1), at most
+// 8 x UWB_CMD_RETRY_BACKOFF_MS and never more than 50ms: the caller sleeps
+// with CONCURRENCY_LOCK held, so that the sequence it runs stays atomic.
+// Default is 0: retransmit right away.
+//
+// Statistics are kept per opcode, RspTimeout_dump() logs them. It runs on
+// deinit and along with the TML stats when EnableThroughPut turns them off.
+//
+class RspTimeoutTracker {
+private:
+  static constexpr unsigned long kDefaultTimeoutMs = HAL_EXTNS_WRITE_RSP_TIMEOUT_MS;
+  static constexpr unsigned long kDefaultMinTimeoutMs = 20;
+  static constexpr unsigned long kDefaultMaxRetries = MAX_COMMAND_RETRY_COUNT;
+  static constexpr uint32_t kSlowCmdTimeoutMs = 300;
+  static constexpr int kMaxBackoffShift = 3;
+  static constexpr uint32_t kMaxBackoffMs = 50;
+
+  struct OpcodeState {
+    uint32_t timeout_ms;          // Configured timeout, upper bound
+    bool has_sample = false;
+    RspTimeout_Stats stats{};
+  };
+
+  static constexpr uint16_t Key(uint8_t gid, uint8_t oid) {
+    return (gid << 8) | oid;
+  }
+
+  std::mutex lock_;
+  std::unordered_map<uint16_t, OpcodeState> opcodes_;
+  std::unordered_map<uint16_t, uint32_t> configured_;
+  unsigned long default_timeout_ms_;
+  unsigned long min_timeout_ms_;
+  unsigned long max_retries_;
+  unsigned long backoff_ms_;
+  bool adaptive_;
+
+public:
+  RspTimeoutTracker() : default_timeout_ms_(kDefaultTimeoutMs), min_timeout_ms_(kDefaultMinTimeoutMs),
+    max_retries_(kDefaultMaxRetries), backoff_ms_(0), adaptive_(false) {
+    unsigned long num = 0;
+
+    if (NxpConfig_GetNum(NAME_UWB_RSP_TIMEOUT_MS, &num, sizeof(num)) && num) {
+      default_timeout_ms_ = num;
+    }
+    if (NxpConfig_GetNum(NAME_UWB_RSP_TIMEOUT_MIN_MS, &num, sizeof(num)) && num) {
+      min_timeout_ms_ = num;
+    }
+    if (NxpConfig_GetNum(NAME_UWB_CMD_RETRY_COUNT, &num, sizeof(num)) && num) {
+      max_retries_ = num;
+    }
+    NxpConfig_GetNum(NAME_UWB_CMD_RETRY_BACKOFF_MS, &backoff_ms_, sizeof(backoff_ms_));
+    num = 0;
+    NxpConfig_GetNum(NAME_UWB_RSP_TIMEOUT_ADAPTIVE, &num, sizeof(num));
+    adaptive_ = (num != 0);
+
+    // Built-in defaults of slow commands
+    configured_[Key(UCI_GID_PROPRIETARY_0X0A, UCI_MSG_READ_CALIB_DATA)] = kSlowCmdTimeoutMs;
+    configured_[Key(UCI_GID_PROPRIETARY_0x0F, SET_VENDOR_SET_CALIBRATION)] = kSlowCmdTimeoutMs;
+
+    // {gid, oid, timeout LSB, timeout MSB} per entry
+    uint8_t table[NXP_MAX_CONFIG_STRING_LEN];
+    long retlen = 0;
+    if (NxpConfig_GetByteArray(NAME_UWB_RSP_TIMEOUT_TABLE, table, sizeof(table), &retlen)) {
+      for (long i = 0; (i + 4) <= retlen; i += 4) {
+        uint32_t timeout_ms = table[i + 2] | (table[i + 3] << 8);
+        if (!timeout_ms) {
+          continue;
+        }
+        configured_[Key(table[i] & UCI_GID_MASK, table[i + 1] & UCI_OID_MASK)] = timeout_ms;
+      }
+    }
+    NXPLOG_UCIHAL_D("RspTimeout: default=%lums min=%lums retries=%lu backoff=%lums adaptive=%d overrides=%zu",
+      default_timeout_ms_, min_timeout_ms_, max_retries_, backoff_ms_, adaptive_, configured_.size());
+  }
+
+  virtual ~RspTimeoutTracker() { }
+
+  uint32_t Get(uint8_t gid, uint8_t oid, int nr_timedout) {
+    std::lock_guard<std::mutex> lock(lock_);
+    OpcodeState &state = GetState(gid, oid);
+    uint64_t timeout_ms = static_cast<uint64_t>(state.stats.timeout_ms) << std::min(nr_timedout, 16);
+    return std::min<uint64_t>(timeout_ms, state.timeout_ms);
+  }
+
+  uint32_t GetBackoff(int nr_retries) {
+    if (!backoff_ms_ || nr_retries < 1) {
+      return 0;
+    }
+    uint64_t backoff_ms = static_cast<uint64_t>(backoff_ms_) << std::min(nr_retries - 1, kMaxBackoffShift);
+    return std::min<uint64_t>(backoff_ms, kMaxBackoffMs);
+  }
+
+  int GetMaxRetries() {
+    return max_retries_;
+  }
+
+  void OnCommand(uint8_t gid, uint8_t oid, int nr_retries, int nr_timedout,
+                 bool failed, uint64_t latency_us) {
+    std::lock_guard<std::mutex> lock(lock_);
+    OpcodeState &state = GetState(gid, oid);
+    RspTimeout_Stats &stats = state.stats;
+
+    stats.commands++;
+    stats.retries += nr_retries;
+    stats.timeouts += nr_timedout;
+    if (failed) {
+      stats.failures++;
+      return;
+    }
+    if (nr_retries) {
+      return;
+    }
+
+    uint32_t sample = std::min<uint64_t>(latency_us, UINT32_MAX);
+    if (sample > stats.max_us) {
+      stats.max_us = sample;
+    }
+    if (!state.has_sample) {
+      state.has_sample = true;
+      stats.srtt_us = sample;
+      stats.rttvar_us = sample / 2;
+    } else {
+      int64_t delta = static_cast<int64_t>(sample) - stats.srtt_us;
+      stats.rttvar_us += ((delta < 0 ? -delta : delta) - static_cast<int64_t>(stats.rttvar_us)) / 4;
+      stats.srtt_us += delta / 8;
+    }
+    if (adaptive_) {
+      uint64_t timeout_ms = (stats.srtt_us + 4ULL * stats.rttvar_us + 999) / 1000;
+      timeout_ms = std::max<uint64_t>(timeout_ms, min_timeout_ms_);
+      stats.timeout_ms = std::min<uint64_t>(timeout_ms, state.timeout_ms);
+    }
+  }
+
+  bool GetStats(uint8_t gid, uint8_t oid, RspTimeout_Stats *stats) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = opcodes_.find(Key(gid, oid));
+    if (it == opcodes_.end()) {
+      return false;
+    }
+    *stats = it->second.stats;
+    return true;
+  }
+
+  std::vector<std::pair<uint8_t, uint8_t>> GetOpcodes() {
+    std::lock_guard<std::mutex> lock(lock_);
+    std::vector<std::pair<uint8_t, uint8_t>> opcodes;
+    for (auto& [key, state] : opcodes_) {
+      opcodes.emplace_back(key >> 8, key & 0xff);
+    }
+    return opcodes;
+  }
+
+  void GetTotalStats(RspTimeout_Stats *stats) {
+    std::lock_guard<std::mutex> lock(lock_);
+    *stats = RspTimeout_Stats{};
+    for (auto& [key, state] : opcodes_) {
+      stats->commands += state.stats.commands;
+      stats->retries += state.stats.retries;
+      stats->timeouts += state.stats.timeouts;
+      stats->failures += state.stats.failures;
+      stats->max_us = std::max(stats->max_us, state.stats.max_us);
+    }
+  }
+
+private:
+  // lock_ held
+  OpcodeState &GetState(uint8_t gid, uint8_t oid) {
+    auto [it, inserted] = opcodes_.try_emplace(Key(gid, oid));
+    if (inserted) {
+      auto conf = configured_.find(Key(gid, oid));
+      it->second.timeout_ms = (conf != configured_.end()) ? conf->second : default_timeout_ms_;
+      it->second.stats.timeout_ms = it->second.timeout_ms;
+    }
+    return it->second;
+  }
+};
+
+static std::unique_ptr<RspTimeoutTracker> gRspTimeout;
+static std::mutex gRspTimeoutLock;
+
+void RspTimeout_init()
+{
+  std::lock_guard<std::mutex> lock(gRspTimeoutLock);
+  gRspTimeout = std::make_unique<RspTimeoutTracker>();
+}
+
+void RspTimeout_deinit()
+{
+  RspTimeout_dump();
+
+  std::lock_guard<std::mutex> lock(gRspTimeoutLock);
+  gRspTimeout.reset();
+}
+
+uint32_t RspTimeout_get(uint8_t gid, uint8_t oid, int nr_timedout)
+{
+  std::lock_guard<std::mutex> lock(gRspTimeoutLock);
+  if (!gRspTimeout) {
+    return HAL_EXTNS_WRITE_RSP_TIMEOUT_MS;
+  }
+  return gRspTimeout->Get(gid, oid, nr_timedout);
+}
+
+uint32_t RspTimeout_getBackoff(int nr_retries)
+{
+  std::lock_guard<std::mutex> lock(gRspTimeoutLock);
+  if (!gRspTimeout) {
+    return 0;
+  }
+  return gRspTimeout->GetBackoff(nr_retries);
+}
+
+int RspTimeout_getMaxRetries()
+{
+  std::lock_guard<std::mutex> lock(gRspTimeoutLock);
+  if (!gRspTimeout) {
+    return MAX_COMMAND_RETRY_COUNT;
+  }
+  return gRspTimeout->GetMaxRetries();
+}
+
+void RspTimeout_onCommand(uint8_t gid, uint8_t oid, int nr_retries, int nr_timedout,
+                          bool failed, uint64_t latency_us)
+{
+  std::lock_guard<std::mutex> lock(gRspTimeoutLock);
+  if (gRspTimeout) {
+    gRspTimeout->OnCommand(gid, oid, nr_retries, nr_timedout, failed, latency_us);
+  }
+}
+
+bool RspTimeout_getStats(uint8_t gid, uint8_t oid, RspTimeout_Stats *stats)
+{
+  std::lock_guard<std::mutex> lock(gRspTimeoutLock);
+  if (!gRspTimeout) {
+    return false;
+  }
+  return gRspTimeout->GetStats(gid, oid, stats);
+}
+
+void RspTimeout_getTotalStats(RspTimeout_Stats *stats)
+{
+  std::lock_guard<std::mutex> lock(gRspTimeoutLock);
+  if (gRspTimeout) {
+    gRspTimeout->GetTotalStats(stats);
+  } else {
+    *stats = RspTimeout_Stats{};
+  }
+}
+
+void RspTimeout_dump()
+{
+  std::vector<std::pair<uint8_t, uint8_t>> opcodes;
+  {
+    std::lock_guard<std::mutex> lock(gRspTimeoutLock);
+    if (!gRspTimeout) {
+      return;
+    }
+    opcodes = gRspTimeout->GetOpcodes();
+  }
+
+  RspTimeout_Stats total;
+  RspTimeout_getTotalStats(&total);
+  NXPLOG_UCIHAL_D("RspTimeout: commands=%llu retries=%llu timeouts=%llu failures=%llu max=%uus",
+    (unsigned long long)total.commands, (unsigned long long)total.retries,
+    (unsigned long long)total.timeouts, (unsigned long long)total.failures, total.max_us);
+
+  for (auto [gid, oid] : opcodes) {
+    RspTimeout_Stats stats;
+    if (!RspTimeout_getStats(gid, oid, &stats)) {
+      continue;
+    }
+    NXPLOG_UCIHAL_D("RspTimeout: gid=0x%x oid=0x%x commands=%llu retries=%llu timeouts=%llu failures=%llu"
+                    " srtt=%uus rttvar=%uus max=%uus timeout=%ums",
+      gid, oid, (unsigned long long)stats.commands, (unsigned long long)stats.retries,
+      (unsigned long long)stats.timeouts, (unsigned long long)stats.failures,
+      stats.srtt_us, stats.rttvar_us, stats.max_us, stats.timeout_ms);
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef _RSPTIMEOUT_H_
+#define _RSPTIMEOUT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Defaults, see UWB_RSP_TIMEOUT_MS and UWB_CMD_RETRY_COUNT
+#define MAX_COMMAND_RETRY_COUNT           5
+#define HAL_EXTNS_WRITE_RSP_TIMEOUT_MS    100
+
+struct RspTimeout_Stats {
+  uint64_t commands;        // Commands sent, retransmissions excluded
+  uint64_t retries;         // Retransmissions, on timeout or COMMAND_RETRANSMIT
+  uint64_t timeouts;        // Attempts without a RSP in time
+  uint64_t failures;        // Commands given up after the last retry
+  uint32_t srtt_us;         // EWMA of the CMD to RSP latency
+  uint32_t rttvar_us;       // EWMA of the latency deviation
+  uint32_t max_us;
+  uint32_t timeout_ms;      // Timeout of the next first attempt
+};
+
+void RspTimeout_init();
+void RspTimeout_deinit();
+
+// Timeout of an attempt, doubled after each timed out attempt of the command
+uint32_t RspTimeout_get(uint8_t gid, uint8_t oid, int nr_timedout);
+// Delay before retransmission nr_retries (>= 1), 0 for an immediate retry
+uint32_t RspTimeout_getBackoff(int nr_retries);
+int RspTimeout_getMaxRetries();
+
+// Reports a command once it's completed or given up.
+// latency_us is the CMD to RSP time of the last attempt, only used as a sample
+// when the command was not retransmitted.
+void RspTimeout_onCommand(uint8_t gid, uint8_t oid, int nr_retries, int nr_timedout,
+                          bool failed, uint64_t latency_us);
+
+// Per opcode statistics, returns false if no command was sent with gid/oid
+bool RspTimeout_getStats(uint8_t gid, uint8_t oid, RspTimeout_Stats *stats);
+// Sum of all opcodes, srtt/rttvar/timeout are left 0
+void RspTimeout_getTotalStats(RspTimeout_Stats *stats);
+// Logs the statistics, part of the TML stats dump
+void RspTimeout_dump();
+#endif
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "phNxpConfig.h"
+#include "phOsalUwb_Thread.h"
 #include "phNxpUciHal.h"
 #include "phNxpUciHal_ext.h"
 #include "phNxpUciHal_utils.h"
@@ -396,6 +397,7 @@ private:
   // Worker thread for auto suspend
   void PowerManagerWorker() {
     NXPLOG_UCIHAL_D("SessionTrack: worker thread started.")
+    phOsalUwb_Thread_ApplyRtProfile(phOsalUwb_ThreadRole_t::SessionTrack);
 
     bool stop_thread = false;
     while (!stop_thread) {
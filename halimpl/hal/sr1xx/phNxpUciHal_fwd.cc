@@ -547,6 +547,7 @@ static phHbci_Status_t phHbci_MasterHIFImage(uint8_t *pImg, uint32_t imgSz)
 {
     ALOGD("phHbci_MasterHIFImage enter");
     phHbci_Status_t ret = phHbci_Failure;
+    struct timespec tStart = {}, tEnd = {};
 
     gphHbci_MosiApdu.cls = (uint8_t)(phHbci_Class_General | phHbci_SubClass_Query);
     gphHbci_MosiApdu.ins = (uint8_t)phHbci_General_Qry_Status;
@@ -573,10 +574,12 @@ static phHbci_Status_t phHbci_MasterHIFImage(uint8_t *pImg, uint32_t imgSz)
             /* Reset GPIO event flag */
            // cppResetGPIOEvent();
 
+            clock_gettime(CLOCK_MONOTONIC, &tStart);
             if (phHbci_Success != (ret = phHbci_PutCommand(pImg, imgSz)))
             {
                 return ret;
             }
+            clock_gettime(CLOCK_MONOTONIC, &tEnd);
 
             /* Wait for GPIO event */
            /* if (0 > cppWaitForGPIOEvent(PHHBCI_GPIO_TIMEOUT_MS))
@@ -595,7 +598,13 @@ static phHbci_Status_t phHbci_MasterHIFImage(uint8_t *pImg, uint32_t imgSz)
             case phHbci_HIF_Image_Ans_Image_Success:
                 ALOGD("HIF Image Transfer Complete.\n");
                 /*Check FW download throughput measurement*/
-                //ioctl((intptr_t)tPalConfig.pDevHandle, SRXXX_GET_THROUGHPUT, 0);
+                {
+                    uint64_t durationUs = (tEnd.tv_sec - tStart.tv_sec) * 1000000ULL +
+                                          (tEnd.tv_nsec - tStart.tv_nsec) / 1000;
+                    ALOGD("HIF Image %u bytes sent in %llu ms, %llu kB/s\n", imgSz,
+                          (unsigned long long)(durationUs / 1000),
+                          (unsigned long long)(durationUs ? (uint64_t)imgSz * 1000 / durationUs : 0));
+                }
                 return phHbci_Success;
 
             case phHbci_HIF_Image_Ans_Header_Too_Large:
@@ -79,6 +79,7 @@ typedef enum {
   ENUM_LINK_TYPE_SPI,
   ENUM_LINK_TYPE_USB,
   ENUM_LINK_TYPE_TCP,
+  ENUM_LINK_TYPE_LOOPBACK,
   ENUM_LINK_TYPE_NB
 } phLibUwb_eConfigLinkType;
 
@@ -107,6 +108,17 @@ struct phLibUwb_Message {
   phLibUwb_Message(uint32_t type, void *data) : eMsgType(type), pMsgData(data) {}
 };
 
+/*
+ * Lanes of the client thread message queue, a lane is only dispatched once
+ * the lanes before it are empty
+ */
+enum phLibUwb_MsgLane {
+  PH_LIBUWB_LANE_RESPONSE = 0,   /* Write completions, responses, data and notifications */
+  PH_LIBUWB_LANE_CONTROL,        /* HAL events and timer expiries */
+  PH_LIBUWB_LANE_NOTIFICATION,   /* Bulk notifications (RANGE_DATA_NTF, debug logs) */
+  PH_LIBUWB_LANE_COUNT
+};
+
 /*
  * Possible Hardware Configuration exposed to upper layer.
  * Typically this should be at least the communication link (Ex:"COM1","COM2")
@@ -18,46 +18,196 @@
 #ifndef PH_MESSAGEQUEUE_H
 #define PH_MESSAGEQUEUE_H
 
-#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 
 #include "phNxpLog.h"
 
+// Multi-producer, single-consumer message queue.
+//
+// Messages go through preallocated rings, send() and recv() take no lock
+// and do not allocate. When a ring is full, messages spill into a locked
+// overflow list, so send() never blocks or fails; while the overflow list is
+// in use new messages are appended to it to keep the FIFO order.
+// The consumer sleeps on a futex (std::atomic::wait), producers only issue
+// the wakeup syscall when it is asleep.
+//
+// A queue can have several lanes, each one FIFO. recv() returns the oldest
+// message of the lowest non-empty lane.
 template <typename T>
 class MessageQueue
 {
 public:
-  MessageQueue(const std::string name) : name_(name) {
+  static constexpr size_t kDefaultCapacity = 256;
+
+  MessageQueue(const std::string name, size_t capacity = kDefaultCapacity, size_t lanes = 1)
+      : name_(name), num_lanes_(lanes) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    lanes_ = std::make_unique<Lane[]>(num_lanes_);
+    for (size_t l = 0; l < num_lanes_; l++) {
+      Lane& lane = lanes_[l];
+      lane.mask = size - 1;
+      lane.cells = std::make_unique<Cell[]>(size);
+      for (size_t i = 0; i < size; i++) {
+        lane.cells[i].seq.store(i, std::memory_order_relaxed);
+      }
+    }
   }
   virtual ~MessageQueue() {
     clear();
     NXPLOG_TML_D("MessageQueue %s destroyed", name_.c_str());
   }
-  void send(std::shared_ptr<T> data) {
-    std::lock_guard<std::mutex> lk(lock_);
-    items_.push(data);
-    cond_.notify_one();
+  void send(std::shared_ptr<T> data, size_t lane_idx = 0) {
+    Lane& lane = lanes_[lane_idx < num_lanes_ ? lane_idx : num_lanes_ - 1];
+    if (lane.overflow_count.load(std::memory_order_acquire) || !ring_push(lane, data)) {
+      std::lock_guard<std::mutex> lk(lane.overflow_lock);
+      lane.overflow.push_back(std::move(data));
+      lane.overflow_count.fetch_add(1, std::memory_order_release);
+    }
+    signal_.fetch_add(1, std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_seq_cst)) {
+      signal_.notify_one();
+    }
   }
-  std::shared_ptr<T> recv() {
-    std::unique_lock<std::mutex> lk(lock_);
-    cond_.wait(lk, [this] { return !items_.empty(); });
-    auto ret = items_.front();
-    items_.pop();
-    return ret;
+  // Consumer only, *lane_idx is set to the lane of the message
+  std::shared_ptr<T> recv(size_t* lane_idx = nullptr) {
+    for (;;) {
+      uint32_t signal = signal_.load(std::memory_order_seq_cst);
+      auto ret = try_recv(lane_idx);
+      if (ret) {
+        return ret;
+      }
+      waiting_.store(true, std::memory_order_seq_cst);
+      ret = try_recv(lane_idx);
+      if (ret) {
+        waiting_.store(false, std::memory_order_relaxed);
+        return ret;
+      }
+      signal_.wait(signal, std::memory_order_seq_cst);
+      waiting_.store(false, std::memory_order_relaxed);
+    }
+  }
+  // Consumer only, waits for a message and returns it together with the
+  // messages already queued behind it in the same lane, up to max_count.
+  // The batch ends early as soon as a message is queued to a lane before it.
+  size_t recv_batch(std::shared_ptr<T>* out, size_t max_count, size_t* lane_idx = nullptr) {
+    size_t lane = 0;
+    size_t count = 0;
+    out[count++] = recv(&lane);
+    while (count < max_count && !pending_before(lane) &&
+           (out[count] = lane_pop(lanes_[lane]))) {
+      count++;
+    }
+    if (lane_idx) {
+      *lane_idx = lane;
+    }
+    return count;
+  }
+  // Consumer only, returns nullptr if the queue is empty
+  std::shared_ptr<T> try_recv(size_t* lane_idx = nullptr) {
+    for (size_t l = 0; l < num_lanes_; l++) {
+      auto ret = lane_pop(lanes_[l]);
+      if (ret) {
+        if (lane_idx) {
+          *lane_idx = l;
+        }
+        return ret;
+      }
+    }
+    return nullptr;
+  }
+  // Consumer only, true if a lane before lane_idx has a message waiting
+  bool pending_before(size_t lane_idx) {
+    for (size_t l = 0; l < lane_idx && l < num_lanes_; l++) {
+      if (pending(l)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  // Consumer only, number of messages waiting in a lane
+  size_t pending(size_t lane_idx) {
+    Lane& lane = lanes_[lane_idx < num_lanes_ ? lane_idx : num_lanes_ - 1];
+    return lane.tail.load(std::memory_order_acquire) - lane.head +
+           lane.overflow_count.load(std::memory_order_acquire);
   }
   void clear() {
-    cond_.notify_all();
-    std::lock_guard<std::mutex> lk(lock_);
-    items_ = std::queue<std::shared_ptr<T>> ();
+    while (try_recv());
   }
 private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    std::shared_ptr<T> data;
+  };
+  struct Lane {
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head{0};
+    std::atomic<size_t> overflow_count{0};
+    std::mutex overflow_lock;
+    std::deque<std::shared_ptr<T>> overflow;
+  };
+
+  static bool ring_push(Lane& lane, std::shared_ptr<T>& data) {
+    size_t pos = lane.tail.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &lane.cells[pos & lane.mask];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (lane.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = lane.tail.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(data);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+  static std::shared_ptr<T> ring_pop(Lane& lane) {
+    Cell* cell = &lane.cells[lane.head & lane.mask];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    if ((intptr_t)seq - (intptr_t)(lane.head + 1) < 0) {
+      return nullptr;  // empty, or the producer has not stored it yet
+    }
+    auto ret = std::move(cell->data);
+    cell->seq.store(lane.head + lane.mask + 1, std::memory_order_release);
+    lane.head++;
+    return ret;
+  }
+  static std::shared_ptr<T> lane_pop(Lane& lane) {
+    auto ret = ring_pop(lane);
+    if (!ret && lane.overflow_count.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lk(lane.overflow_lock);
+      // Messages queued to the ring before the overflow started go first
+      ret = ring_pop(lane);
+      if (!ret && !lane.overflow.empty()) {
+        ret = std::move(lane.overflow.front());
+        lane.overflow.pop_front();
+        lane.overflow_count.fetch_sub(1, std::memory_order_release);
+      }
+    }
+    return ret;
+  }
+
   std::string name_;
-  std::queue<std::shared_ptr<T>> items_;
-  std::mutex lock_;
-  std::condition_variable cond_;
+  size_t num_lanes_;
+  std::unique_ptr<Lane[]> lanes_;
+  std::atomic<uint32_t> signal_{0};
+  std::atomic<bool> waiting_{false};
 };
 
 #endif  // _NXP_UWB_MESSAGEQUEUE_H
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <phNxpConfig.h>
+#include <phNxpLog.h>
+#include <phOsalUwb_Thread.h>
+
+#define PH_OSALUWB_THREAD_ROLES ((int)phOsalUwb_ThreadRole_t::Count)
+/* UWB_RT_THREAD_AFFINITY holds a 32-bit little endian CPU mask per role */
+#define PH_OSALUWB_AFFINITY_MASK_LEN (4)
+#define PH_OSALUWB_AFFINITY_MAX_CPUS (PH_OSALUWB_AFFINITY_MASK_LEN * 8)
+
+/* SCHED_FIFO priorities used when UWB_RT_THREAD_PRIORITY is not set:
+ * I/O threads above the client and DATA TX threads, above the timer threads */
+static const uint8_t kDefaultRtPriority[PH_OSALUWB_THREAD_ROLES] = { 3, 3, 2, 1, 0, 2 };
+
+static const char* kRoleNames[PH_OSALUWB_THREAD_ROLES] = {
+  "TmlReader", "TmlWriter", "Client", "Timer", "SessionTrack", "DataTx"
+};
+
+static bool bRtProfile = false;
+static bool bMemLocked = false;
+static uint8_t rtPriority[PH_OSALUWB_THREAD_ROLES];
+static uint32_t rtAffinity[PH_OSALUWB_THREAD_ROLES];
+
+/*******************************************************************************
+**
+** Function         phOsalUwb_Thread_LoadAffinity
+**
+** Description      Reads the CPU mask of every role from
+**                  UWB_RT_THREAD_AFFINITY. CPUs the system doesn't have are
+**                  removed from the masks, a mask left empty keeps the
+**                  default affinity
+**
+** Parameters       None
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phOsalUwb_Thread_LoadAffinity(void)
+{
+  uint8_t buffer[PH_OSALUWB_THREAD_ROLES * PH_OSALUWB_AFFINITY_MASK_LEN] = {};
+  long retlen = 0;
+
+  memset(rtAffinity, 0, sizeof(rtAffinity));
+  if (!NxpConfig_GetByteArray(NAME_UWB_RT_THREAD_AFFINITY, buffer, sizeof(buffer), &retlen)) {
+    return;
+  }
+  if (retlen % PH_OSALUWB_AFFINITY_MASK_LEN) {
+    NXPLOG_TML_W("RT profile: UWB_RT_THREAD_AFFINITY length %ld is not a multiple of %d",
+                 retlen, PH_OSALUWB_AFFINITY_MASK_LEN);
+  }
+
+  long nrCpus = sysconf(_SC_NPROCESSORS_CONF);
+  uint32_t validMask = 0xFFFFFFFF;
+  if (nrCpus > 0 && nrCpus < PH_OSALUWB_AFFINITY_MAX_CPUS) {
+    validMask = (1u << nrCpus) - 1;
+  }
+
+  for (int idx = 0; idx < PH_OSALUWB_THREAD_ROLES; idx++) {
+    long off = idx * PH_OSALUWB_AFFINITY_MASK_LEN;
+    if (off + PH_OSALUWB_AFFINITY_MASK_LEN > retlen) {
+      break;
+    }
+    uint32_t mask = buffer[off] | (buffer[off + 1] << 8) | (buffer[off + 2] << 16) |
+                    ((uint32_t)buffer[off + 3] << 24);
+    if (mask & ~validMask) {
+      NXPLOG_TML_W("RT profile: %s affinity 0x%08x has CPUs above %ld, ignored",
+                   kRoleNames[idx], mask, nrCpus - 1);
+    }
+    rtAffinity[idx] = mask & validMask;
+  }
+}
+
+/*******************************************************************************
+**
+** Function         phOsalUwb_Thread_LoadRtProfile
+**
+** Description      Reads the real-time profile from the configuration and
+**                  locks the process memory when it is enabled.
+**                  Shall be called before the HAL threads are created
+**
+** Parameters       None
+**
+** Returns          None
+**
+*******************************************************************************/
+void phOsalUwb_Thread_LoadRtProfile(void)
+{
+  unsigned long num = 0;
+  long retlen = 0;
+
+  bRtProfile = NxpConfig_GetNum(NAME_UWB_RT_PROFILE, &num, sizeof(num)) && num;
+  if (!bRtProfile) {
+    return;
+  }
+
+  memcpy(rtPriority, kDefaultRtPriority, sizeof(rtPriority));
+  NxpConfig_GetByteArray(NAME_UWB_RT_THREAD_PRIORITY, rtPriority, sizeof(rtPriority), &retlen);
+  phOsalUwb_Thread_LoadAffinity();
+
+  if (!bMemLocked) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+      NXPLOG_TML_W("RT profile: mlockall failed, errno=%d", errno);
+    } else {
+      bMemLocked = true;
+    }
+  }
+  NXPLOG_TML_D("RT profile enabled");
+}
+
+/*******************************************************************************
+**
+** Function         phOsalUwb_Thread_UnloadRtProfile
+**
+** Description      Unlocks the process memory locked by the real-time profile
+**
+** Parameters       None
+**
+** Returns          None
+**
+*******************************************************************************/
+void phOsalUwb_Thread_UnloadRtProfile(void)
+{
+  if (bMemLocked) {
+    munlockall();
+    bMemLocked = false;
+  }
+  bRtProfile = false;
+}
+
+bool phOsalUwb_Thread_IsRtProfile(void)
+{
+  return bRtProfile;
+}
+
+/*******************************************************************************
+**
+** Function         phOsalUwb_Thread_ApplyRtProfile
+**
+** Description      Applies the priority and CPU affinity of eRole to the
+**                  calling thread. Does nothing without the real-time profile
+**
+** Parameters       eRole - role of the calling thread
+**
+** Returns          None
+**
+*******************************************************************************/
+void phOsalUwb_Thread_ApplyRtProfile(phOsalUwb_ThreadRole_t eRole)
+{
+  int idx = (int)eRole;
+
+  if (!bRtProfile || idx < 0 || idx >= PH_OSALUWB_THREAD_ROLES) {
+    return;
+  }
+
+  if (rtPriority[idx]) {
+    struct sched_param param = {};
+    param.sched_priority = rtPriority[idx];
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret) {
+      NXPLOG_TML_W("RT profile: %s SCHED_FIFO %d failed, err=%d", kRoleNames[idx],
+                   rtPriority[idx], ret);
+    }
+  }
+
+  if (rtAffinity[idx]) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu = 0; cpu < PH_OSALUWB_AFFINITY_MAX_CPUS; cpu++) {
+      if (rtAffinity[idx] & (1u << cpu)) {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+    if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+      NXPLOG_TML_W("RT profile: %s affinity 0x%08x failed, errno=%d", kRoleNames[idx],
+                   rtAffinity[idx], errno);
+    }
+  }
+  NXPLOG_TML_D("RT profile: %s prio %d cpus 0x%08x", kRoleNames[idx], rtPriority[idx],
+               rtAffinity[idx]);
+}
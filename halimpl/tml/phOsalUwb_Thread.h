@@ -0,0 +1,48 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PHOSALUWB_THREAD_H
+#define PHOSALUWB_THREAD_H
+
+/*
+ * Real-time profile of the HAL threads
+ *
+ * When UWB_RT_PROFILE is set, every HAL thread applies the SCHED_FIFO
+ * priority and CPU affinity configured for its role when it starts, and the
+ * process memory is locked so the packet paths never page fault.
+ * Without the profile threads keep the default scheduling.
+ */
+
+/*
+ * HAL thread roles, in the order of the UWB_RT_THREAD_PRIORITY and
+ * UWB_RT_THREAD_AFFINITY arrays
+ */
+enum class phOsalUwb_ThreadRole_t {
+  TmlReader = 0,
+  TmlWriter,     /* Also the single I/O thread */
+  Client,
+  Timer,
+  SessionTrack,
+  DataTx,        /* Asynchronous DATA writes, see phNxpUciHal_cmd.h */
+  Count,
+};
+
+void phOsalUwb_Thread_LoadRtProfile(void);
+void phOsalUwb_Thread_UnloadRtProfile(void);
+bool phOsalUwb_Thread_IsRtProfile(void);
+void phOsalUwb_Thread_ApplyRtProfile(phOsalUwb_ThreadRole_t eRole);
+
+#endif /* PHOSALUWB_THREAD_H */
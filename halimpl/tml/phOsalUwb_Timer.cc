@@ -18,11 +18,14 @@
 #include <phUwbTypes.h>
 #include <phNxpLog.h>
 #include <phNxpUciHal.h>
+#include <phOsalUwb_Thread.h>
 #include <phOsalUwb_Timer.h>
 #include <signal.h>
 
 #define PH_UWB_MAX_TIMER (5U)
 static phOsalUwb_TimerHandle_t apTimerInfo[PH_UWB_MAX_TIMER];
+/* Expiry messages, allocated once so that expiries do not allocate */
+static std::shared_ptr<phLibUwb_Message> apTimerMsg[PH_UWB_MAX_TIMER];
 
 extern phNxpUciHal_Control_t nxpucihal_ctrl;
 
@@ -79,6 +82,10 @@ uint32_t phOsalUwb_Timer_Create(void) {
    */
   if ((PH_UWB_TIMER_ID_ZERO != dwTimerId) && (dwTimerId <= PH_UWB_MAX_TIMER)) {
     pTimerHandle = (phOsalUwb_TimerHandle_t*)&apTimerInfo[dwTimerId - 1];
+    if (!apTimerMsg[dwTimerId - 1]) {
+      apTimerMsg[dwTimerId - 1] = std::make_shared<phLibUwb_Message>(
+          PH_LIBUWB_DEFERREDCALL_MSG, &pTimerHandle->tDeferredCallInfo);
+    }
     /* Build the Timer Id to be returned to Caller Function */
     dwTimerId += PH_UWB_TIMER_BASE_ADDRESS;
     se.sigev_value.sival_int = (int)dwTimerId;
@@ -351,9 +358,15 @@ static void phOsalUwb_DeferredCall(void* pParams) {
 **
 *******************************************************************************/
 static void phOsalUwb_Timer_Expired(union sigval sv) {
+  static thread_local bool bRtApplied = false;
   uint32_t dwIndex;
   phOsalUwb_TimerHandle_t* pTimerHandle;
 
+  if (!bRtApplied) {
+    phOsalUwb_Thread_ApplyRtProfile(phOsalUwb_ThreadRole_t::Timer);
+    bRtApplied = true;
+  }
+
   dwIndex = (uint32_t)(((uint32_t)(sv.sival_int)) - PH_UWB_TIMER_BASE_ADDRESS - 0x01);
   pTimerHandle = (phOsalUwb_TimerHandle_t*)&apTimerInfo[dwIndex];
   /* Timer is stopped when callback function is invoked */
@@ -363,8 +376,7 @@ static void phOsalUwb_Timer_Expired(union sigval sv) {
   pTimerHandle->tDeferredCallInfo.pParam = (void*)((intptr_t)(sv.sival_int));
 
   /* Post a message on the queue to invoke the function */
-  auto msg = std::make_shared<phLibUwb_Message>(PH_LIBUWB_DEFERREDCALL_MSG, &pTimerHandle->tDeferredCallInfo);
-  nxpucihal_ctrl.gDrvCfg.pClientMq->send(msg);
+  nxpucihal_ctrl.gDrvCfg.pClientMq->send(apTimerMsg[dwIndex], PH_LIBUWB_LANE_CONTROL);
 }
 
 /*******************************************************************************
@@ -16,11 +16,23 @@
 
 #include <phNxpLog.h>
 #include <phNxpUciHal_utils.h>
+#include <phOsalUwb_Thread.h>
 #include <phOsalUwb_Timer.h>
 #include <phTmlUwb.h>
 #include <phTmlUwb_spi.h>
+#include <phTmlUwb_stats.h>
+#include <phTmlUwb_transport.h>
 #include <phNxpUciHal.h>
+#include <phNxpUciHal_ext.h>
+#include <phNxpConfig.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+#include <new>
 
 extern phNxpUciHal_Control_t nxpucihal_ctrl;
 
@@ -47,12 +59,29 @@ static void phTmlUwb_ReadDeferredCb(void* pParams);
 static void phTmlUwb_WriteDeferredCb(void* pParams);
 static void* phTmlUwb_TmlReaderThread(void* pParam);
 static void* phTmlUwb_TmlWriterThread(void* pParam);
+static void* phTmlUwb_TmlIoThread(void* pParam);
+static bool phTmlUwb_ReadPacket(phTmlUwb_RxSlot_t* pSlot);
+static bool phTmlUwb_IsBulkNtf(const uint8_t* pPacket, uint16_t wLength);
+static int32_t phTmlUwb_ReadFramed(phTmlUwb_RxSlot_t* pSlot);
+static int32_t phTmlUwb_ReadExact(uint8_t* pBuffer, uint16_t wLength, bool bContinuation);
+static tHAL_UWB_STATUS phTmlUwb_AllocRxBuffers(uint16_t wLength);
+static void phTmlUwb_SetNonBlocking(bool bNonBlocking);
+static void phTmlUwb_WriteQueued(bool bFirstTaken);
+static phTmlUwb_RxSlot_t* phTmlUwb_AcquireRxSlot(bool bWait);
+static void phTmlUwb_ReleaseRxSlot(phTmlUwb_RxSlot_t* pSlot);
+static void phTmlUwb_KickIoThread(void);
+static tHAL_UWB_STATUS phTmlUwb_InitIoThreadFds(void);
+static void phTmlUwb_UpdateRxArm(void);
+static void phTmlUwb_AckRxStop(uint32_t dwRxStopReq);
+static void phTmlUwb_DeliverRxSlot(phTmlUwb_RxSlot_t* pSlot);
+static void phTmlUwb_DispatchRxSlot(phTmlUwb_RxSlot_t* pSlot);
+static void phTmlUwb_DispatchWriteEntry(phTmlUwb_TxEntry_t* pEntry);
+static void phTmlUwb_PostNtfCopy(phTmlUwb_RxSlot_t* pSlot);
+static void phTmlUwb_NtfCopyDeferredCb(void* pParams);
+static void phTmlUwb_FlushTxQueue(void);
 
 extern void setDeviceHandle(void* pDevHandle);
 
-static void phTmlUwb_WaitWriteComplete(void);
-static void phTmlUwb_SignalWriteComplete(void);
-static int phTmlUwb_WaitReadInit(void);
 
 /* Function definitions */
 
@@ -64,8 +93,9 @@ static int phTmlUwb_WaitReadInit(void);
 **                  Configures given hardware interface and sends handle to the
 **                  caller
 **
-** Parameters       pConfig - TML configuration details as provided by the upper
-**                            layer
+** Parameters       pDevName - device node, or address of the simulated UWBS
+**                  eLinkType - transport to the UWBS, see phTmlUwb_GetTransport
+**                  pClientMq - client thread message queue
 **
 ** Returns          UWB status:
 **                  UWBSTATUS_SUCCESS - initialization successful
@@ -77,7 +107,8 @@ static int phTmlUwb_WaitReadInit(void);
 **                                             been disconnected
 **
 *******************************************************************************/
-tHAL_UWB_STATUS phTmlUwb_Init(const char* pDevName, std::shared_ptr<MessageQueue<phLibUwb_Message>> pClientMq)
+tHAL_UWB_STATUS phTmlUwb_Init(const char* pDevName, phLibUwb_eConfigLinkType eLinkType,
+                              std::shared_ptr<MessageQueue<phLibUwb_Message>> pClientMq)
 {
   tHAL_UWB_STATUS wInitStatus = UWBSTATUS_SUCCESS;
 
@@ -87,40 +118,84 @@ tHAL_UWB_STATUS phTmlUwb_Init(const char* pDevName, std::shared_ptr<MessageQueue
     wInitStatus = PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_ALREADY_INITIALISED);
   }
   /* Validate Input parameters */
-  else if (!pDevName || !pClientMq) {
+  else if (!pDevName || !pClientMq || !phTmlUwb_GetTransport(eLinkType)) {
     /*Parameters passed to TML init are wrong */
     wInitStatus = PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_INVALID_PARAMETER);
   } else {
-    /* Allocate memory for TML context */
-    gpphTmlUwb_Context =
-        (phTmlUwb_Context_t*)malloc(sizeof(phTmlUwb_Context_t));
+    /* Allocate memory for TML context, value-initialized: plain members are
+     * zeroed and the shared_ptr/atomic members are constructed */
+    gpphTmlUwb_Context = new (std::nothrow) phTmlUwb_Context_t();
 
     if (NULL == gpphTmlUwb_Context) {
       wInitStatus = PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_FAILED);
     } else {
-      /* Initialise all the internal TML variables */
-      memset(gpphTmlUwb_Context, PH_TMLUWB_RESET_VALUE,
-             sizeof(phTmlUwb_Context_t));
+      gpphTmlUwb_Context->epollFd = -1;
+      gpphTmlUwb_Context->eventFd = -1;
+
+      unsigned long num = 0;
+      if (NxpConfig_GetNum(NAME_UWB_TML_SINGLE_IO_THREAD, &num, sizeof(num)) && num) {
+        gpphTmlUwb_Context->bSingleIoThread = true;
+        gpphTmlUwb_Context->bBatchRead = (num >= 2);
+      }
+      num = 0;
+      if (NxpConfig_GetNum(NAME_UWB_TML_FRAMED_READ, &num, sizeof(num)) && num) {
+        gpphTmlUwb_Context->bFramedRead = true;
+      }
+      num = 0;
+      if (NxpConfig_GetNum(NAME_UWB_TML_INLINE_DISPATCH, &num, sizeof(num)) && num) {
+        gpphTmlUwb_Context->bInlineDispatch = true;
+      }
+      num = 0;
+      if (NxpConfig_GetNum(NAME_UWB_NTF_DROP_THRESHOLD, &num, sizeof(num))) {
+        gpphTmlUwb_Context->wNtfDropThreshold = (uint16_t)num;
+      }
+      num = 0;
+      if (NxpConfig_GetNum(NAME_UWB_TML_STATS_ENABLE, &num, sizeof(num)) && num) {
+        phTmlUwb_Stats_Enable(true);
+      }
 
       /* Open the device file to which data is read/written */
-      wInitStatus = phTmlUwb_spi_open_and_configure(pDevName, &(gpphTmlUwb_Context->pDevHandle));
+      gpphTmlUwb_Context->pTransport = phTmlUwb_GetTransport(eLinkType);
+      NXPLOG_TML_D("TML transport: %s", gpphTmlUwb_Context->pTransport->pName);
+      if (gpphTmlUwb_Context->pTransport->bStream) {
+        gpphTmlUwb_Context->bFramedRead = true;
+      }
+      wInitStatus = gpphTmlUwb_Context->pTransport->open(pDevName, &(gpphTmlUwb_Context->pDevHandle));
 
       if (UWBSTATUS_SUCCESS != wInitStatus) {
         wInitStatus = PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_INVALID_DEVICE);
         gpphTmlUwb_Context->pDevHandle = NULL;
       } else {
-        gpphTmlUwb_Context->tWriteInfo.bThreadBusy = false;
         gpphTmlUwb_Context->pClientMq = pClientMq;
 
         setDeviceHandle(gpphTmlUwb_Context->pDevHandle);  // To set device handle for FW download usecase
 
         if (0 != sem_init(&gpphTmlUwb_Context->rxSemaphore, 0, 0)) {
           wInitStatus = UWBSTATUS_FAILED;
+        } else if (0 != pthread_mutex_init(&gpphTmlUwb_Context->rxSlotLock, NULL)) {
+          wInitStatus = UWBSTATUS_FAILED;
+        } else if (0 != pthread_mutex_init(&gpphTmlUwb_Context->txQueueLock, NULL)) {
+          wInitStatus = UWBSTATUS_FAILED;
+        } else if (0 != pthread_mutex_init(&gpphTmlUwb_Context->rxStopLock, NULL)) {
+          wInitStatus = UWBSTATUS_FAILED;
+        } else if (0 != pthread_cond_init(&gpphTmlUwb_Context->rxStopCond, NULL)) {
+          wInitStatus = UWBSTATUS_FAILED;
         } else if (0 != sem_init(&gpphTmlUwb_Context->txSemaphore, 0, 0)) {
           wInitStatus = UWBSTATUS_FAILED;
-        } else if(0 != phTmlUwb_WaitReadInit()) {
-           wInitStatus = UWBSTATUS_FAILED;
+        } else if (0 != sem_init(&gpphTmlUwb_Context->rxLargeSemaphore, 0, 0)) {
+          wInitStatus = UWBSTATUS_FAILED;
+        } else if (gpphTmlUwb_Context->bSingleIoThread &&
+                   UWBSTATUS_SUCCESS != phTmlUwb_InitIoThreadFds()) {
+          wInitStatus = UWBSTATUS_FAILED;
         } else {
+          /* Deferred call messages are reused for every write of the entry */
+          for (int i = 0; i < PH_TMLUWB_TX_QUEUE_SIZE; i++) {
+            phTmlUwb_TxEntry_t* pEntry = &gpphTmlUwb_Context->txQueue[i];
+            pEntry->tDeferredInfo.pCallback = &phTmlUwb_WriteDeferredCb;
+            pEntry->tDeferredInfo.pParameter = pEntry;
+            pEntry->pMsg = std::make_shared<phLibUwb_Message>(
+                PH_LIBUWB_DEFERREDCALL_MSG, &pEntry->tDeferredInfo);
+          }
           /* Start TML thread (to handle write and read operations) */
           if (UWBSTATUS_SUCCESS != phTmlUwb_StartWriterThread()) {
             wInitStatus = PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_FAILED);
@@ -141,6 +216,34 @@ tHAL_UWB_STATUS phTmlUwb_Init(const char* pDevName, std::shared_ptr<MessageQueue
   return wInitStatus;
 }
 
+/*******************************************************************************
+**
+** Function         phTmlUwb_GetTransport
+**
+** Description      Maps a link type to its transport
+**
+** Parameters       eLinkType - ENUM_LINK_TYPE_SPI: SPI character device
+**                              ENUM_LINK_TYPE_TCP: TCP or Unix stream socket
+**                              ENUM_LINK_TYPE_LOOPBACK: in-process socket pair
+**
+** Returns          transport, NULL if the link type is not supported
+**
+*******************************************************************************/
+const phTmlUwb_Transport_t* phTmlUwb_GetTransport(phLibUwb_eConfigLinkType eLinkType)
+{
+  switch (eLinkType) {
+    case ENUM_LINK_TYPE_SPI:
+      return &phTmlUwb_SpiTransport;
+    case ENUM_LINK_TYPE_TCP:
+      return &phTmlUwb_SocketTransport;
+    case ENUM_LINK_TYPE_LOOPBACK:
+      return &phTmlUwb_LoopbackTransport;
+    default:
+      NXPLOG_TML_E("Unsupported link type %d", eLinkType);
+      return NULL;
+  }
+}
+
 /*******************************************************************************
 **
 ** Function         phTmlUwb_TmlReaderThread
@@ -156,92 +259,375 @@ static void* phTmlUwb_TmlReaderThread(void* pParam)
 {
   UNUSED(pParam);
 
-  /* Transaction info buffer to be passed to Callback Thread */
-  static phTmlUwb_TransactInfo_t tTransactionInfo;
-  /* Structure containing Tml callback function and parameters to be invoked
-     by the callback thread */
-  static phLibUwb_DeferredCall_t tDeferredInfo;
-
   gpphTmlUwb_Context->tReadInfo.bThreadRunning = true;
   NXPLOG_TML_D("TmlReader: Thread Started");
+  phOsalUwb_Thread_ApplyRtProfile(phOsalUwb_ThreadRole_t::TmlReader);
 
-  /* Writer thread loop shall be running till shutdown is invoked */
+  /* Reader thread loop shall be running till shutdown is invoked */
   while (!gpphTmlUwb_Context->tReadInfo.bThreadShouldStop) {
     NXPLOG_TML_V("TmlReader: Running");
-    if(sem_wait(&gpphTmlUwb_Context->rxSemaphore)) {
-      NXPLOG_TML_E("TmlReader: Failed to wait rxSemaphore err=%d", errno);
+
+    /* Wait until the client thread has handed back at least one slot */
+    phTmlUwb_RxSlot_t* pSlot = phTmlUwb_AcquireRxSlot(true);
+    if (!pSlot) {
       break;
     }
 
-    tHAL_UWB_STATUS wStatus = UWBSTATUS_SUCCESS;
-
     /* Read the data from the file onto the buffer */
     if (!gpphTmlUwb_Context->pDevHandle) {
       NXPLOG_TML_E("TmlRead: invalid file handle");
+      phTmlUwb_ReleaseRxSlot(pSlot);
       break;
     }
 
-    NXPLOG_TML_V("TmlReader:  Invoking SPI Read");
+    phTmlUwb_ReadPacket(pSlot);
+  } /* End of While loop */
 
-    uint8_t temp[UCI_MAX_DATA_LEN];
-    int32_t dwNoBytesWrRd =
-        phTmlUwb_spi_read(gpphTmlUwb_Context->pDevHandle, temp, UCI_MAX_DATA_LEN);
+  gpphTmlUwb_Context->tReadInfo.bThreadRunning = false;
+  NXPLOG_TML_D("Tml Reader: Thread stopped");
 
-    if(gpphTmlUwb_Context->tReadInfo.bThreadShouldStop) {
-      break;
+  return NULL;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_IsBulkNtf
+**
+** Description      Tells whether a packet is a high rate notification that
+**                  may wait behind responses and control events:
+**                  RANGE_DATA_NTF and the debug frame logs.
+**                  Other notifications (session status, generic errors, data
+**                  credits...) keep their arrival order with responses.
+**
+** Parameters       pPacket - UCI packet
+**                  wLength - length of pPacket
+**
+** Returns          true for a bulk notification
+**
+*******************************************************************************/
+static bool phTmlUwb_IsBulkNtf(const uint8_t* pPacket, uint16_t wLength)
+{
+  if (wLength < UCI_MSG_HDR_SIZE || (pPacket[0] & 0x60) != 0x60) {
+    return false;
+  }
+  uint8_t gid = pPacket[0] & UCI_GID_MASK;
+  uint8_t oid = pPacket[1] & UCI_OID_MASK;
+  return (gid == UCI_GID_SESSION_CONTROL && oid == UCI_OID_RANGE_DATA_NTF) ||
+         (gid == UCI_GID_INTERNAL && oid == UCI_EXT_PARAM_DBG_RFRAME_LOG_NTF);
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_ReadPacket
+**
+** Description      Reads one packet into the given slot and posts it to the
+**                  client thread. The slot is released on failure.
+**
+** Parameters       pSlot - free RX slot
+**
+** Returns          true if a packet has been posted
+**
+*******************************************************************************/
+static bool phTmlUwb_ReadPacket(phTmlUwb_RxSlot_t* pSlot)
+{
+  tHAL_UWB_STATUS wStatus = UWBSTATUS_SUCCESS;
+
+  NXPLOG_TML_V("TmlReader:  Invoking SPI Read");
+
+  uint64_t startNs = phTmlUwb_Stats_Begin();
+  int32_t dwNoBytesWrRd;
+  if (gpphTmlUwb_Context->bFramedRead) {
+    dwNoBytesWrRd = phTmlUwb_ReadFramed(pSlot);
+  } else {
+    dwNoBytesWrRd =
+        gpphTmlUwb_Context->pTransport->read(gpphTmlUwb_Context->pDevHandle, pSlot->pBuffer,
+                                             gpphTmlUwb_Context->wRxBufferLen);
+  }
+  uint8_t* pPacket = pSlot->pLargeBuffer ? pSlot->pLargeBuffer : pSlot->pBuffer;
+  uint16_t wPacketBufferLen = pSlot->pLargeBuffer ? gpphTmlUwb_Context->wRxLargeBufferLen
+                                                  : gpphTmlUwb_Context->wRxBufferLen;
+  if (-1 == dwNoBytesWrRd && errno == ENOBUFS) {
+    /* Resumed by the I/O thread once a large buffer is back, keeps the slot */
+    return false;
+  }
+  if (!(-1 == dwNoBytesWrRd && (errno == EAGAIN || errno == EWOULDBLOCK))) {
+    phTmlUwb_Stats_EndRead(startNs, dwNoBytesWrRd);
+  }
+
+  if(gpphTmlUwb_Context->tReadInfo.bThreadShouldStop) {
+    phTmlUwb_ReleaseRxSlot(pSlot);
+    return false;
+  }
+
+  if (-1 == dwNoBytesWrRd && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    /* Non-blocking device drained */
+    phTmlUwb_ReleaseRxSlot(pSlot);
+    return false;
+  } else if (-1 == dwNoBytesWrRd) {
+    NXPLOG_TML_E("TmlReader: Error in SPI Read");
+    phTmlUwb_ReleaseRxSlot(pSlot);
+  } else if (dwNoBytesWrRd > wPacketBufferLen) {
+    NXPLOG_TML_E("TmlReader: Numer of bytes read exceeds the limit");
+    phTmlUwb_ReleaseRxSlot(pSlot);
+  } else if(0 == dwNoBytesWrRd) {
+    NXPLOG_TML_E("TmlReader: Empty packet Read, Ignore read and try new read");
+    phTmlUwb_ReleaseRxSlot(pSlot);
+  } else {
+    NXPLOG_TML_V("TmlReader: SPI Read successful");
+
+    NXPLOG_TML_V("TmlReader: Posting read message");
+
+    /* Fill the Transaction info structure to be passed to Callback
+     * Function */
+    pSlot->tTransactionInfo.wStatus = wStatus;
+    pSlot->tTransactionInfo.pBuff = pPacket;
+    pSlot->tTransactionInfo.wLength = (uint16_t)dwNoBytesWrRd;
+
+    /* Anything but a notification may answer the last write, it must not
+     * overtake that write's completion on the client thread */
+    pSlot->bOrdered = ((pPacket[0] & 0x60) != 0x60);
+    pSlot->bBulk = phTmlUwb_IsBulkNtf(pPacket, (uint16_t)dwNoBytesWrRd);
+    pSlot->dwTxSeq = gpphTmlUwb_Context->txSeq.load();
+
+    if (gpphTmlUwb_Context->bInlineDispatch) {
+      /* Deliver from this thread, unless the packet has to wait for a
+       * write completion. REENTRANCE_LOCK keeps it apart from the messages
+       * the client thread dispatches meanwhile. */
+      REENTRANCE_LOCK();
+      phTmlUwb_ReadDeferredCb(pSlot);
+      REENTRANCE_UNLOCK();
+      return true;
     }
 
-    if (-1 == dwNoBytesWrRd) {
-      NXPLOG_TML_E("TmlReader: Error in SPI Read");
-      sem_post(&gpphTmlUwb_Context->rxSemaphore);
-    } else if (dwNoBytesWrRd > UCI_MAX_DATA_LEN) {
-      NXPLOG_TML_E("TmlReader: Numer of bytes read exceeds the limit");
-      sem_post(&gpphTmlUwb_Context->rxSemaphore);
-    } else if(0 == dwNoBytesWrRd) {
-      NXPLOG_TML_E("TmlReader: Empty packet Read, Ignore read and try new read");
-      sem_post(&gpphTmlUwb_Context->rxSemaphore);
-    } else {
-      memcpy(gpphTmlUwb_Context->tReadInfo.pBuffer, temp, dwNoBytesWrRd);
+    if (pSlot->bBulk && gpphTmlUwb_Context->wNtfDropThreshold) {
+      phTmlUwb_PostNtfCopy(pSlot);
+      return true;
+    }
 
-      NXPLOG_TML_V("TmlReader: SPI Read successful");
+    /* Read operation completed successfully. Post the slot's preallocated
+     * message onto Callback Thread */
+    phTmlUwb_DeferredCall(pSlot->pMsg, pSlot->bBulk ? PH_LIBUWB_LANE_NOTIFICATION
+                                                    : PH_LIBUWB_LANE_RESPONSE);
+    return true;
+  }
+  return false;
+}
 
-      /* Update the actual number of bytes read including header */
-      gpphTmlUwb_Context->tReadInfo.wLength = (uint16_t)(dwNoBytesWrRd);
+/*******************************************************************************
+**
+** Function         phTmlUwb_ReadExact
+**
+** Description      Reads exactly wLength bytes, the transport may return them
+**                  in several pieces
+**
+** Parameters       pBuffer       - buffer for read data
+**                  wLength       - number of bytes to read
+**                  bContinuation - part of a packet whose header has already
+**                                  been read, wait for the bytes on a
+**                                  non-blocking device
+**
+** Returns          wLength, 0 if the link is closed, -1 on failure or, with
+**                  errno EAGAIN, if a non-blocking device has no packet
+**
+*******************************************************************************/
+static int32_t phTmlUwb_ReadExact(uint8_t* pBuffer, uint16_t wLength, bool bContinuation)
+{
+  uint16_t wRead = 0;
 
-      dwNoBytesWrRd = PH_TMLUWB_RESET_VALUE;
+  while (wRead < wLength) {
+    int32_t ret = gpphTmlUwb_Context->pTransport->read(gpphTmlUwb_Context->pDevHandle,
+                                                       pBuffer + wRead, wLength - wRead);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && (bContinuation || wRead)) {
+      /* Rest of the packet is on its way */
+      if (gpphTmlUwb_Context->tReadInfo.bThreadShouldStop) {
+        return -1;
+      }
+      struct pollfd pfd = {};
+      pfd.fd = (int)(intptr_t)gpphTmlUwb_Context->pDevHandle;
+      pfd.events = POLLIN;
+      poll(&pfd, 1, 100);
+      continue;
+    }
+    if (ret <= 0) {
+      return wRead ? -1 : ret;
+    }
+    wRead += ret;
+  }
+  return wRead;
+}
 
-      NXPLOG_TML_V("TmlReader: Posting read message");
+/*******************************************************************************
+**
+** Function         phTmlUwb_ReadFramed
+**
+** Description      Reads one packet header first: the UCI header gives the
+**                  payload length, packets which do not fit the slot buffer
+**                  are read into a large buffer attached to the slot.
+**                  The single I/O thread does not wait for a large buffer:
+**                  the slot is kept as pRxPendingSlot with its header read
+**                  and the packet is resumed when a large buffer is back.
+**
+** Parameters       pSlot - RX slot
+**
+** Returns          packet length, 0 if the link is closed, -1 on failure or,
+**                  with errno ENOBUFS, if the packet is pending
+**
+*******************************************************************************/
+static int32_t phTmlUwb_ReadFramed(phTmlUwb_RxSlot_t* pSlot)
+{
+  uint8_t* pPacket = pSlot->pBuffer;
+  int32_t ret;
 
-      /* Fill the Transaction info structure to be passed to Callback
-       * Function */
-      tTransactionInfo.wStatus = wStatus;
-      tTransactionInfo.pBuff = gpphTmlUwb_Context->tReadInfo.pBuffer;
-      tTransactionInfo.wLength = gpphTmlUwb_Context->tReadInfo.wLength;
+  if (pSlot == gpphTmlUwb_Context->pRxPendingSlot) {
+    gpphTmlUwb_Context->pRxPendingSlot = NULL;
+  } else {
+    ret = phTmlUwb_ReadExact(pPacket, NORMAL_MODE_HEADER_LEN, false);
+    if (ret != NORMAL_MODE_HEADER_LEN) {
+      return ret;
+    }
+  }
 
-      /* Read operation completed successfully. Post a Message onto Callback
-       * Thread*/
-      /* Prepare the message to be posted on User thread */
-      tDeferredInfo.pCallback = &phTmlUwb_ReadDeferredCb;
-      tDeferredInfo.pParameter = &tTransactionInfo;
+  /* Data packets and extended control packets carry a 16-bit length */
+  uint16_t wPayloadLen = pPacket[NORMAL_MODE_LEN_OFFSET];
+  if ((((pPacket[0] & UCI_MT_MASK) >> UCI_MT_SHIFT) == UCI_MT_DATA) ||
+      (pPacket[EXTENDED_SIZE_LEN_OFFSET] & EXTND_LEN_INDICATOR_OFFSET_MASK)) {
+    wPayloadLen = le_bytes_to_cpu<uint16_t>(&pPacket[EXTENDED_MODE_LEN_OFFSET]);
+  }
+  uint32_t dwPacketLen = NORMAL_MODE_HEADER_LEN + wPayloadLen;
+
+  if (dwPacketLen > gpphTmlUwb_Context->wRxBufferLen) {
+    if (dwPacketLen > gpphTmlUwb_Context->wRxLargeBufferLen) {
+      NXPLOG_TML_E("TmlReader: packet of %u bytes too large, dropped", dwPacketLen);
+      /* Skip the payload to stay in sync with the stream */
+      while (wPayloadLen) {
+        uint16_t wChunk = std::min<uint16_t>(wPayloadLen, gpphTmlUwb_Context->wRxBufferLen);
+        if (phTmlUwb_ReadExact(pSlot->pBuffer, wChunk, true) != wChunk) {
+          break;
+        }
+        wPayloadLen -= wChunk;
+      }
+      errno = EMSGSIZE;
+      return -1;
+    }
 
-      /* TML reader writer callback synchronization mutex lock --- START */
-      pthread_mutex_lock(&gpphTmlUwb_Context->wait_busy_lock);
-      if ((gpphTmlUwb_Context->gWriterCbflag == false) &&
-        ((gpphTmlUwb_Context->tReadInfo.pBuffer[0] & 0x60) != 0x60)) {
-        phTmlUwb_WaitWriteComplete();
+    /* Wait for the client thread to give back a large buffer, the single
+     * I/O thread has writes to serve meanwhile */
+    if (gpphTmlUwb_Context->bSingleIoThread) {
+      if (sem_trywait(&gpphTmlUwb_Context->rxLargeSemaphore)) {
+        gpphTmlUwb_Context->pRxPendingSlot = pSlot;
+        errno = ENOBUFS;
+        return -1;
       }
-      /* TML reader writer callback synchronization mutex lock --- END */
-      pthread_mutex_unlock(&gpphTmlUwb_Context->wait_busy_lock);
+    } else if (sem_wait(&gpphTmlUwb_Context->rxLargeSemaphore)) {
+      return -1;
+    }
+    if (gpphTmlUwb_Context->tReadInfo.bThreadShouldStop) {
+      return -1;
+    }
+    pthread_mutex_lock(&gpphTmlUwb_Context->rxSlotLock);
+    pSlot->pLargeBuffer =
+        gpphTmlUwb_Context->rxLargeFree[--gpphTmlUwb_Context->rxLargeFreeCount];
+    pthread_mutex_unlock(&gpphTmlUwb_Context->rxSlotLock);
+
+    memcpy(pSlot->pLargeBuffer, pPacket, NORMAL_MODE_HEADER_LEN);
+    pPacket = pSlot->pLargeBuffer;
+  }
 
-      auto msg = std::make_shared<phLibUwb_Message>(PH_LIBUWB_DEFERREDCALL_MSG, &tDeferredInfo);
-      phTmlUwb_DeferredCall(msg);
+  if (wPayloadLen) {
+    ret = phTmlUwb_ReadExact(pPacket + NORMAL_MODE_HEADER_LEN, wPayloadLen, true);
+    if (ret != wPayloadLen) {
+      NXPLOG_TML_E("TmlReader: payload read error, %d of %u bytes", ret, wPayloadLen);
+      errno = EIO;
+      return -1;
     }
-  } /* End of While loop */
+  }
+  return dwPacketLen;
+}
 
-  gpphTmlUwb_Context->tReadInfo.bThreadRunning = false;
-  NXPLOG_TML_D("Tml Reader: Thread stopped");
+/*******************************************************************************
+**
+** Function         phTmlUwb_AcquireRxSlot
+**
+** Description      Takes the next free slot of the reader ring
+**
+** Parameters       bWait - wait for the client thread to release a slot if
+**                          all of them are in flight
+**
+** Returns          RX slot, or NULL if the reader has to stop or, when bWait
+**                  is false, no slot is free
+**
+*******************************************************************************/
+static phTmlUwb_RxSlot_t* phTmlUwb_AcquireRxSlot(bool bWait)
+{
+  phTmlUwb_RxSlot_t* pSlot;
 
-  return NULL;
+  if (!bWait) {
+    if (sem_trywait(&gpphTmlUwb_Context->rxSemaphore)) {
+      return NULL;
+    }
+  } else if (sem_wait(&gpphTmlUwb_Context->rxSemaphore)) {
+    NXPLOG_TML_E("TmlReader: Failed to wait rxSemaphore err=%d", errno);
+    return NULL;
+  }
+  if (gpphTmlUwb_Context->tReadInfo.bThreadShouldStop) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&gpphTmlUwb_Context->rxSlotLock);
+  if (!gpphTmlUwb_Context->rxFreeCount) {
+    pthread_mutex_unlock(&gpphTmlUwb_Context->rxSlotLock);
+    NXPLOG_TML_E("TmlReader: no free RX slot");
+    return NULL;
+  }
+  uint8_t idx = gpphTmlUwb_Context->rxFreeSlots[gpphTmlUwb_Context->rxFreeHead];
+  gpphTmlUwb_Context->rxFreeHead =
+      (gpphTmlUwb_Context->rxFreeHead + 1) % PH_TMLUWB_RX_SLOT_COUNT;
+  gpphTmlUwb_Context->rxFreeCount--;
+  pSlot = &gpphTmlUwb_Context->rxSlots[idx];
+  pthread_mutex_unlock(&gpphTmlUwb_Context->rxSlotLock);
+
+  return pSlot;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_ReleaseRxSlot
+**
+** Description      Returns a slot to the tail of the reader ring and wakes up
+**                  the reader thread
+**
+** Parameters       pSlot - slot taken by phTmlUwb_AcquireRxSlot()
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_ReleaseRxSlot(phTmlUwb_RxSlot_t* pSlot)
+{
+  uint8_t* pLargeBuffer = pSlot->pLargeBuffer;
+  pSlot->pLargeBuffer = NULL;
+
+  pthread_mutex_lock(&gpphTmlUwb_Context->rxSlotLock);
+  if (pLargeBuffer) {
+    gpphTmlUwb_Context->rxLargeFree[gpphTmlUwb_Context->rxLargeFreeCount++] = pLargeBuffer;
+  }
+  uint8_t tail = (gpphTmlUwb_Context->rxFreeHead + gpphTmlUwb_Context->rxFreeCount)
+      % PH_TMLUWB_RX_SLOT_COUNT;
+  gpphTmlUwb_Context->rxFreeSlots[tail] = (uint8_t)(pSlot - gpphTmlUwb_Context->rxSlots);
+  gpphTmlUwb_Context->rxFreeCount++;
+  pthread_mutex_unlock(&gpphTmlUwb_Context->rxSlotLock);
+
+  if (pLargeBuffer) {
+    sem_post(&gpphTmlUwb_Context->rxLargeSemaphore);
+  }
+  sem_post(&gpphTmlUwb_Context->rxSemaphore);
+
+  /* The I/O thread stops polling the device while no slot is free */
+  if (gpphTmlUwb_Context->bSingleIoThread && !gpphTmlUwb_Context->bRxArmed.load()) {
+    phTmlUwb_KickIoThread();
+  }
 }
 
 /*******************************************************************************
@@ -259,14 +645,9 @@ static void* phTmlUwb_TmlWriterThread(void* pParam)
 {
   UNUSED(pParam);
 
-  /* Transaction info buffer to be passed to Callback Thread */
-  static phTmlUwb_TransactInfo_t tTransactionInfo;
-  /* Structure containing Tml callback function and parameters to be invoked
-     by the callback thread */
-  static phLibUwb_DeferredCall_t tDeferredInfo;
-
   gpphTmlUwb_Context->tWriteInfo.bThreadRunning = true;
   NXPLOG_TML_D("TmlWriter: Thread Started");
+  phOsalUwb_Thread_ApplyRtProfile(phOsalUwb_ThreadRole_t::TmlWriter);
 
   /* Writer thread loop shall be running till shutdown is invoked */
   while (!gpphTmlUwb_Context->tWriteInfo.bThreadShouldStop) {
@@ -275,26 +656,72 @@ static void* phTmlUwb_TmlWriterThread(void* pParam)
       NXPLOG_TML_E("TmlWriter: Failed to wait txSemaphore, err=%d", errno);
       break;
     }
-
-    tHAL_UWB_STATUS wStatus = UWBSTATUS_SUCCESS;
+    if (gpphTmlUwb_Context->tWriteInfo.bThreadShouldStop) {
+      break;
+    }
 
     if (!gpphTmlUwb_Context->pDevHandle) {
       NXPLOG_TML_E("TmlWriter: invalid file handle");
       break;
     }
 
-    NXPLOG_TML_V("TmlWriter: Invoking SPI Write");
+    phTmlUwb_WriteQueued(true);
+  } /* End of While loop */
+
+  gpphTmlUwb_Context->tWriteInfo.bThreadRunning = false;
+  NXPLOG_TML_D("TmlWriter: Thread stopped");
+
+  return NULL;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_WriteQueued
+**
+** Description      Writes every queued entry back to back, completions are
+**                  posted once the whole batch has been written.
+**                  On the single I/O thread a non-blocking device may refuse
+**                  a write with EAGAIN: the entry stays first in line and
+**                  the device is polled for EPOLLOUT until it is retried.
+**
+** Parameters       bFirstTaken - txSemaphore has already been decremented
+**                                for the first entry
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_WriteQueued(bool bFirstTaken)
+{
+  if (!bFirstTaken && sem_trywait(&gpphTmlUwb_Context->txSemaphore)) {
+    return;
+  }
+
+  pthread_mutex_lock(&gpphTmlUwb_Context->txQueueLock);
+  uint8_t first = gpphTmlUwb_Context->txWriteIdx;
+  pthread_mutex_unlock(&gpphTmlUwb_Context->txQueueLock);
+  uint8_t nWritten = 0;
+
+  do {
+    phTmlUwb_TxEntry_t* pEntry =
+        &gpphTmlUwb_Context->txQueue[(first + nWritten) % PH_TMLUWB_TX_QUEUE_SIZE];
+    tHAL_UWB_STATUS wStatus = UWBSTATUS_SUCCESS;
 
-    /* TML reader writer callback synchronization mutex lock --- START
-      */
-    pthread_mutex_lock(&gpphTmlUwb_Context->wait_busy_lock);
-    gpphTmlUwb_Context->gWriterCbflag = false;
+    /* Responses read from now on are ordered after this completion */
+    pEntry->dwSeq = gpphTmlUwb_Context->txSeq.fetch_add(1) + 1;
+
+    NXPLOG_TML_V("TmlWriter: Invoking SPI Write");
+    uint64_t startNs = phTmlUwb_Stats_Begin();
     int32_t dwNoBytesWrRd =
-        phTmlUwb_spi_write(gpphTmlUwb_Context->pDevHandle,
-                            gpphTmlUwb_Context->tWriteInfo.pBuffer,
-                            gpphTmlUwb_Context->tWriteInfo.wLength);
-    /* TML reader writer callback synchronization mutex lock --- END */
-    pthread_mutex_unlock(&gpphTmlUwb_Context->wait_busy_lock);
+        gpphTmlUwb_Context->pTransport->write(gpphTmlUwb_Context->pDevHandle,
+                                              pEntry->pBuffer, pEntry->wLength);
+    gpphTmlUwb_Context->bTxBlocked = (-1 == dwNoBytesWrRd) &&
+                                     gpphTmlUwb_Context->bSingleIoThread &&
+                                     (errno == EAGAIN || errno == EWOULDBLOCK);
+    if (gpphTmlUwb_Context->bTxBlocked) {
+      NXPLOG_TML_D("TmlIo: device busy, write deferred until EPOLLOUT");
+      break;
+    }
+    phTmlUwb_Stats_EndWrite(startNs, dwNoBytesWrRd);
 
     /* Try SPI Write Five Times, if it fails :*/
     if (-1 == dwNoBytesWrRd) {
@@ -302,46 +729,300 @@ static void* phTmlUwb_TmlWriterThread(void* pParam)
       wStatus = PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_FAILED);
     } else {
       phNxpUciHal_print_packet(NXP_TML_UCI_CMD_AP_2_UWBS,
-                                gpphTmlUwb_Context->tWriteInfo.pBuffer,
-                                gpphTmlUwb_Context->tWriteInfo.wLength);
-    }
-    if (UWBSTATUS_SUCCESS == wStatus) {
+                                pEntry->pBuffer, pEntry->wLength);
       NXPLOG_TML_V("TmlWriter: SPI Write successful");
       dwNoBytesWrRd = PH_TMLUWB_VALUE_ONE;
     }
 
-    NXPLOG_TML_V("TmlWriter: Posting write message");
-
     /* Fill the Transaction info structure to be passed to Callback Function
      */
-    tTransactionInfo.wStatus = wStatus;
-    tTransactionInfo.pBuff = gpphTmlUwb_Context->tWriteInfo.pBuffer;
-    tTransactionInfo.wLength = (uint16_t)dwNoBytesWrRd;
-
-    /* Prepare the message to be posted on the User thread */
-    tDeferredInfo.pCallback = &phTmlUwb_WriteDeferredCb;
-    tDeferredInfo.pParameter = &tTransactionInfo;
-
-    auto msg = std::make_shared<phLibUwb_Message>(PH_LIBUWB_DEFERREDCALL_MSG, &tDeferredInfo);
-    phTmlUwb_DeferredCall(msg);
-
-    if (UWBSTATUS_SUCCESS == wStatus) {
-      /* TML reader writer callback synchronization mutex lock --- START
-          */
-      pthread_mutex_lock(&gpphTmlUwb_Context->wait_busy_lock);
-      gpphTmlUwb_Context->gWriterCbflag = true;
-      phTmlUwb_SignalWriteComplete();
-        /* TML reader writer callback synchronization mutex lock --- END */
-      pthread_mutex_unlock(&gpphTmlUwb_Context->wait_busy_lock);
+    pEntry->tTransactionInfo.wStatus = wStatus;
+    /* Completion callbacks only read the written buffer */
+    pEntry->tTransactionInfo.pBuff = const_cast<uint8_t*>(pEntry->pBuffer);
+    pEntry->tTransactionInfo.wLength = (uint16_t)dwNoBytesWrRd;
+    pEntry->bWritten = true;
+    nWritten++;
+  } while (!gpphTmlUwb_Context->tWriteInfo.bThreadShouldStop &&
+           !sem_trywait(&gpphTmlUwb_Context->txSemaphore));
+
+  pthread_mutex_lock(&gpphTmlUwb_Context->txQueueLock);
+  gpphTmlUwb_Context->txWriteIdx = (first + nWritten) % PH_TMLUWB_TX_QUEUE_SIZE;
+  pthread_mutex_unlock(&gpphTmlUwb_Context->txQueueLock);
+
+  NXPLOG_TML_V("TmlWriter: Posting %d write message(s)", nWritten);
+  for (uint8_t i = 0; i < nWritten; i++) {
+    phTmlUwb_DeferredCall(
+        gpphTmlUwb_Context->txQueue[(first + i) % PH_TMLUWB_TX_QUEUE_SIZE].pMsg,
+        PH_LIBUWB_LANE_RESPONSE);
+  }
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_InitIoThreadFds
+**
+** Description      Creates the epoll instance and the eventfd used by the
+**                  single I/O thread mode
+**
+** Parameters       None
+**
+** Returns          UWB status:
+**                  UWBSTATUS_SUCCESS - epoll and eventfd are ready
+**                  UWBSTATUS_FAILED - failed to create or register them
+**
+*******************************************************************************/
+static tHAL_UWB_STATUS phTmlUwb_InitIoThreadFds(void)
+{
+  struct epoll_event ev;
+
+  gpphTmlUwb_Context->eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (gpphTmlUwb_Context->eventFd < 0) {
+    NXPLOG_TML_E("TmlIo: eventfd failed err=%d", errno);
+    return UWBSTATUS_FAILED;
+  }
+  gpphTmlUwb_Context->epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (gpphTmlUwb_Context->epollFd < 0) {
+    NXPLOG_TML_E("TmlIo: epoll_create1 failed err=%d", errno);
+    return UWBSTATUS_FAILED;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = gpphTmlUwb_Context->eventFd;
+  if (epoll_ctl(gpphTmlUwb_Context->epollFd, EPOLL_CTL_ADD,
+                gpphTmlUwb_Context->eventFd, &ev)) {
+    NXPLOG_TML_E("TmlIo: failed to add eventfd err=%d", errno);
+    return UWBSTATUS_FAILED;
+  }
+
+  /* The device is registered disarmed, StartRead() arms it */
+  memset(&ev, 0, sizeof(ev));
+  ev.data.fd = (intptr_t)gpphTmlUwb_Context->pDevHandle;
+  if (epoll_ctl(gpphTmlUwb_Context->epollFd, EPOLL_CTL_ADD,
+                (intptr_t)gpphTmlUwb_Context->pDevHandle, &ev)) {
+    NXPLOG_TML_E("TmlIo: failed to add device err=%d", errno);
+    return UWBSTATUS_FAILED;
+  }
+  gpphTmlUwb_Context->bRxArmed = false;
+  gpphTmlUwb_Context->dwDevEvents = 0;
+  gpphTmlUwb_Context->bTxBlocked = false;
+  gpphTmlUwb_Context->pRxPendingSlot = NULL;
+
+  return UWBSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_TmlIoThread
+**
+** Description      Single I/O thread used instead of the reader and writer
+**                  threads when UWB_TML_SINGLE_IO_THREAD is set.
+**                  Waits in epoll on the device, readable while a RX slot is
+**                  free, and on an eventfd signalled for TX submission, slot
+**                  release and shutdown.
+**
+** Parameters       pParam  - context provided by upper layer
+**
+** Returns          None
+**
+*******************************************************************************/
+static void* phTmlUwb_TmlIoThread(void* pParam)
+{
+  UNUSED(pParam);
+  struct epoll_event events[2];
+
+  gpphTmlUwb_Context->tWriteInfo.bThreadRunning = true;
+  NXPLOG_TML_D("TmlIo: Thread Started");
+  phOsalUwb_Thread_ApplyRtProfile(phOsalUwb_ThreadRole_t::TmlWriter);
+
+  while (!gpphTmlUwb_Context->tWriteInfo.bThreadShouldStop) {
+    int nEvents = epoll_wait(gpphTmlUwb_Context->epollFd, events, 2, -1);
+    if (nEvents < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      NXPLOG_TML_E("TmlIo: epoll_wait failed err=%d", errno);
+      break;
     }
-  } /* End of While loop */
+
+    bool bReadable = false;
+    for (int i = 0; i < nEvents; i++) {
+      if (events[i].data.fd == gpphTmlUwb_Context->eventFd) {
+        uint64_t count;
+        (void)read(gpphTmlUwb_Context->eventFd, &count, sizeof(count));
+      } else if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        bReadable = true;
+      }
+    }
+    if (gpphTmlUwb_Context->tWriteInfo.bThreadShouldStop) {
+      break;
+    }
+
+    /* Commands first, their responses are what the device sends next */
+    phTmlUwb_WriteQueued(gpphTmlUwb_Context->bTxBlocked);
+
+    /* Stop requests seen from here on are acknowledged below, their
+     * bThreadRunning=false is visible to everything that follows */
+    uint32_t dwRxStopReq = gpphTmlUwb_Context->dwRxStopReq.load(std::memory_order_acquire);
+
+    /* In batch mode the device is non-blocking and every packet already
+     * queued by the driver is reaped before going back to epoll_wait().
+     * A packet waiting for a large buffer is resumed first. */
+    while (gpphTmlUwb_Context->tReadInfo.bThreadRunning) {
+      phTmlUwb_RxSlot_t* pSlot = gpphTmlUwb_Context->pRxPendingSlot;
+      if (!pSlot) {
+        pSlot = bReadable ? phTmlUwb_AcquireRxSlot(false) : NULL;
+        if (!pSlot) {
+          break;
+        }
+      }
+      bReadable = phTmlUwb_ReadPacket(pSlot) && gpphTmlUwb_Context->bBatchRead;
+      if (gpphTmlUwb_Context->pRxPendingSlot) {
+        break;
+      }
+    }
+
+    phTmlUwb_UpdateRxArm();
+    phTmlUwb_AckRxStop(dwRxStopReq);
+  }
 
   gpphTmlUwb_Context->tWriteInfo.bThreadRunning = false;
-  NXPLOG_TML_D("TmlWriter: Thread stopped");
+  /* Nobody is left to read, release any phTmlUwb_StopRead() */
+  phTmlUwb_AckRxStop(gpphTmlUwb_Context->dwRxStopReq.load(std::memory_order_acquire));
+  NXPLOG_TML_D("TmlIo: Thread stopped");
 
   return NULL;
 }
 
+/*******************************************************************************
+**
+** Function         phTmlUwb_AckRxStop
+**
+** Description      Acknowledges the stop requests up to dwRxStopReq to
+**                  phTmlUwb_StopRead(). Called by the I/O thread once it is
+**                  out of read() and the device is disarmed
+**
+** Parameters       dwRxStopReq - last stop request seen before reading
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_AckRxStop(uint32_t dwRxStopReq)
+{
+  pthread_mutex_lock(&gpphTmlUwb_Context->rxStopLock);
+  if (gpphTmlUwb_Context->dwRxStopAck != dwRxStopReq) {
+    gpphTmlUwb_Context->dwRxStopAck = dwRxStopReq;
+    pthread_cond_broadcast(&gpphTmlUwb_Context->rxStopCond);
+  }
+  pthread_mutex_unlock(&gpphTmlUwb_Context->rxStopLock);
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_UpdateRxArm
+**
+** Description      Polls the device for input only while reading is started,
+**                  a RX slot is free and no packet waits for a large buffer.
+**                  A slot or large buffer released after the device has been
+**                  disarmed kicks the I/O thread to re-arm it.
+**                  Also polls for output while a write is deferred.
+**
+** Parameters       None
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_UpdateRxArm(void)
+{
+  bool bArm = false;
+
+  if (gpphTmlUwb_Context->tReadInfo.bThreadRunning &&
+      !gpphTmlUwb_Context->tReadInfo.bThreadShouldStop) {
+    /* Publish the disarmed state before looking at the free slots, so that a
+     * concurrent release either is seen here or kicks the eventfd */
+    gpphTmlUwb_Context->bRxArmed = false;
+    bool bRetry = false;
+    pthread_mutex_lock(&gpphTmlUwb_Context->rxSlotLock);
+    if (gpphTmlUwb_Context->pRxPendingSlot) {
+      bRetry = (gpphTmlUwb_Context->rxLargeFreeCount > 0);
+    } else {
+      bArm = (gpphTmlUwb_Context->rxFreeCount > 0);
+    }
+    pthread_mutex_unlock(&gpphTmlUwb_Context->rxSlotLock);
+    if (bRetry) {
+      /* Large buffer given back after the pending packet gave up */
+      phTmlUwb_KickIoThread();
+    }
+  }
+
+  uint32_t dwEvents = (bArm ? (uint32_t)EPOLLIN : 0u) |
+                      (gpphTmlUwb_Context->bTxBlocked ? (uint32_t)EPOLLOUT : 0u);
+  if (dwEvents != gpphTmlUwb_Context->dwDevEvents) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = dwEvents;
+    ev.data.fd = (intptr_t)gpphTmlUwb_Context->pDevHandle;
+    if (epoll_ctl(gpphTmlUwb_Context->epollFd, EPOLL_CTL_MOD,
+                  (intptr_t)gpphTmlUwb_Context->pDevHandle, &ev)) {
+      NXPLOG_TML_E("TmlIo: failed to update device events err=%d", errno);
+    }
+    gpphTmlUwb_Context->dwDevEvents = dwEvents;
+  }
+  gpphTmlUwb_Context->bRxArmed = bArm;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_KickIoThread
+**
+** Description      Wakes up the single I/O thread
+**
+** Parameters       None
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_KickIoThread(void)
+{
+  uint64_t one = 1;
+
+  if (write(gpphTmlUwb_Context->eventFd, &one, sizeof(one)) != sizeof(one)) {
+    NXPLOG_TML_E("TmlIo: failed to signal eventfd err=%d", errno);
+  }
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_SetNonBlocking
+**
+** Description      Switches the device between blocking and non-blocking
+**                  read()/write(). Batch reads need a non-blocking device,
+**                  falls back to one read per wakeup if it cannot be set.
+**                  The device is only non-blocking while reading is started,
+**                  firmware download uses the same handle with blocking io.
+**                  A write() refused meanwhile is retried on EPOLLOUT, see
+**                  phTmlUwb_WriteQueued().
+**
+** Parameters       bNonBlocking - true to set O_NONBLOCK
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_SetNonBlocking(bool bNonBlocking)
+{
+  int fd = (intptr_t)gpphTmlUwb_Context->pDevHandle;
+  int flags = fcntl(fd, F_GETFL);
+
+  if (flags >= 0) {
+    flags = bNonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    if (!fcntl(fd, F_SETFL, flags)) {
+      return;
+    }
+  }
+  NXPLOG_TML_E("TmlIo: failed to update O_NONBLOCK err=%d, batch read disabled", errno);
+  gpphTmlUwb_Context->bBatchRead = false;
+}
+
 /*******************************************************************************
 **
 ** Function         phTmlUwb_CleanUp
@@ -358,18 +1039,41 @@ static void phTmlUwb_CleanUp(void) {
     return;
   }
   if (NULL != gpphTmlUwb_Context->pDevHandle) {
-    (void)phTmlUwb_Spi_Ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, 0);
+    (void)gpphTmlUwb_Context->pTransport->ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, 0);
   }
 
   sem_destroy(&gpphTmlUwb_Context->rxSemaphore);
   sem_destroy(&gpphTmlUwb_Context->txSemaphore);
-  pthread_mutex_destroy(&gpphTmlUwb_Context->wait_busy_lock);
-  pthread_cond_destroy(&gpphTmlUwb_Context->wait_busy_condition);
-  phTmlUwb_spi_close(gpphTmlUwb_Context->pDevHandle);
+  sem_destroy(&gpphTmlUwb_Context->rxLargeSemaphore);
+  pthread_mutex_destroy(&gpphTmlUwb_Context->rxSlotLock);
+  pthread_mutex_destroy(&gpphTmlUwb_Context->txQueueLock);
+  pthread_mutex_destroy(&gpphTmlUwb_Context->rxStopLock);
+  pthread_cond_destroy(&gpphTmlUwb_Context->rxStopCond);
+  if (gpphTmlUwb_Context->epollFd >= 0) {
+    close(gpphTmlUwb_Context->epollFd);
+  }
+  if (gpphTmlUwb_Context->eventFd >= 0) {
+    close(gpphTmlUwb_Context->eventFd);
+  }
+  for (int i = 0; i < PH_TMLUWB_TX_QUEUE_SIZE; i++) {
+    gpphTmlUwb_Context->txQueue[i].pMsg.reset();
+  }
+  for (int i = 0; i < PH_TMLUWB_RX_SLOT_COUNT; i++) {
+    free(gpphTmlUwb_Context->rxSlots[i].pBuffer);
+    gpphTmlUwb_Context->rxSlots[i].pBuffer = NULL;
+    gpphTmlUwb_Context->rxSlots[i].pMsg.reset();
+  }
+  for (int i = 0; i < PH_TMLUWB_RX_LARGE_BUFFER_COUNT; i++) {
+    free(gpphTmlUwb_Context->rxLargeBuffers[i]);
+    gpphTmlUwb_Context->rxLargeBuffers[i] = NULL;
+  }
+  if (NULL != gpphTmlUwb_Context->pTransport) {
+    gpphTmlUwb_Context->pTransport->close(gpphTmlUwb_Context->pDevHandle);
+  }
   gpphTmlUwb_Context->pDevHandle = NULL;
 
   /* Clear memory allocated for storing Context variables */
-  free((void*)gpphTmlUwb_Context);
+  delete gpphTmlUwb_Context;
   /* Set the pointer to NULL to indicate De-Initialization */
   gpphTmlUwb_Context = NULL;
 
@@ -403,6 +1107,15 @@ tHAL_UWB_STATUS phTmlUwb_Shutdown(void)
 
   phTmlUwb_StopWriterThread();
 
+  // Callers may still wait for writes which will not complete anymore
+  phTmlUwb_FlushTxQueue();
+
+  phTmlUwb_Stats_Enable(false);
+  if (gpphTmlUwb_Context->dwNtfDropped) {
+    NXPLOG_TML_W("%u RANGE_DATA_NTF dropped on notification lane overflow",
+                 gpphTmlUwb_Context->dwNtfDropped);
+  }
+
   phTmlUwb_CleanUp();
 
   return UWBSTATUS_SUCCESS;
@@ -413,15 +1126,14 @@ tHAL_UWB_STATUS phTmlUwb_Shutdown(void)
 ** Function         phTmlUwb_Write
 **
 ** Description      Asynchronously writes given data block to hardware
-**                  interface/driver. Enables writer thread if there are no
-**                  write requests pending. Returns successfully once writer
-**                  thread completes write operation. Notifies upper layer using
-**                  callback mechanism.
+**                  interface/driver. Queues the request to the writer thread,
+**                  which writes queued requests in order. Returns once the
+**                  request is queued. Notifies upper layer using callback
+**                  mechanism once the data has been written.
 **
 **                  NOTE:
-**                  * it is important to post a message with id
-**                    PH_TMLUWB_WRITE_MESSAGE to IntegrationThread after data
-**                    has been written to SRxxx
+**                  * pBuffer is not copied and must stay valid until
+**                    pTmlWriteComplete has been invoked
 **                  * if CRC needs to be computed, then input buffer should be
 **                    capable to store two more bytes apart from length of
 **                    packet
@@ -436,10 +1148,11 @@ tHAL_UWB_STATUS phTmlUwb_Shutdown(void)
 **                  UWBSTATUS_PENDING - command is yet to be processed
 **                  UWBSTATUS_INVALID_PARAMETER - at least one parameter is
 **                                                invalid
-**                  UWBSTATUS_BUSY - write request is already in progress
+**                  UWBSTATUS_BUSY - PH_TMLUWB_TX_QUEUE_SIZE writes are
+**                                   already pending
 **
 *******************************************************************************/
-tHAL_UWB_STATUS phTmlUwb_Write(uint8_t* pBuffer, uint16_t wLength,
+tHAL_UWB_STATUS phTmlUwb_Write(const uint8_t* pBuffer, uint16_t wLength,
                          pphTmlUwb_TransactCompletionCb_t pTmlWriteComplete,
                          void* pContext) {
   tHAL_UWB_STATUS wWriteStatus;
@@ -449,23 +1162,31 @@ tHAL_UWB_STATUS phTmlUwb_Write(uint8_t* pBuffer, uint16_t wLength,
   if (NULL != gpphTmlUwb_Context) {
     if ((NULL != gpphTmlUwb_Context->pDevHandle) && (NULL != pBuffer) &&
         (PH_TMLUWB_RESET_VALUE != wLength) && (NULL != pTmlWriteComplete)) {
-      if (!gpphTmlUwb_Context->tWriteInfo.bThreadBusy) {
-        /* Setting the flag marks beginning of a Write Operation */
-        gpphTmlUwb_Context->tWriteInfo.bThreadBusy = true;
+      pthread_mutex_lock(&gpphTmlUwb_Context->txQueueLock);
+      if (gpphTmlUwb_Context->txCount < PH_TMLUWB_TX_QUEUE_SIZE) {
         /* Copy the buffer, length and Callback function,
            This shall be utilized while invoking the Callback function in thread
            */
-        gpphTmlUwb_Context->tWriteInfo.pBuffer = pBuffer;
-        gpphTmlUwb_Context->tWriteInfo.wLength = wLength;
-        gpphTmlUwb_Context->tWriteInfo.pThread_Callback = pTmlWriteComplete;
-        gpphTmlUwb_Context->tWriteInfo.pContext = pContext;
+        phTmlUwb_TxEntry_t* pEntry = &gpphTmlUwb_Context->txQueue[
+            (gpphTmlUwb_Context->txHead + gpphTmlUwb_Context->txCount) % PH_TMLUWB_TX_QUEUE_SIZE];
+        pEntry->pBuffer = pBuffer;
+        pEntry->wLength = wLength;
+        pEntry->pCallback = pTmlWriteComplete;
+        pEntry->pContext = pContext;
+        pEntry->bWritten = false;
+        gpphTmlUwb_Context->txCount++;
 
         wWriteStatus = UWBSTATUS_PENDING;
         /* Set event to invoke Writer Thread */
         sem_post(&gpphTmlUwb_Context->txSemaphore);
+        if (gpphTmlUwb_Context->bSingleIoThread) {
+          phTmlUwb_KickIoThread();
+        }
       } else {
+        NXPLOG_TML_E("TmlWrite: TX queue full");
         wWriteStatus = PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_BUSY);
       }
+      pthread_mutex_unlock(&gpphTmlUwb_Context->txQueueLock);
     } else {
       wWriteStatus = PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_INVALID_PARAMETER);
     }
@@ -478,30 +1199,80 @@ tHAL_UWB_STATUS phTmlUwb_Write(uint8_t* pBuffer, uint16_t wLength,
 
 /*******************************************************************************
 **
-** Function         phTmlUwb_Read
+** Function         phTmlUwb_AllocRxBuffers
+**
+** Description      Allocates the RX buffers for packets of up to wLength
+**                  bytes. With framed reads the slot buffers are limited to
+**                  PH_TMLUWB_RX_SMALL_BUFFER_LEN and larger packets use the
+**                  large buffers. Buffers are kept until TML shutdown.
 **
-** Description      Asynchronously reads data from the driver
-**                  Number of bytes to be read and buffer are passed by upper
-**                  layer.
-**                  Enables reader thread if there are no read requests pending
-**                  Returns successfully once read operation is completed
-**                  Notifies upper layer using callback mechanism
+** Parameters       wLength - maximum packet length
 **
-** Parameters       pBuffer - location to send read data to the upper layer via
-**                            callback
-**                  wLength - length of read data buffer passed by upper layer
+** Returns          UWBSTATUS_SUCCESS or UWBSTATUS_FAILED
+**
+*******************************************************************************/
+static tHAL_UWB_STATUS phTmlUwb_AllocRxBuffers(uint16_t wLength)
+{
+  uint16_t wSlotLen = wLength;
+  uint16_t wLargeLen = 0;
+
+  if (gpphTmlUwb_Context->bFramedRead && wLength > PH_TMLUWB_RX_SMALL_BUFFER_LEN) {
+    wSlotLen = PH_TMLUWB_RX_SMALL_BUFFER_LEN;
+    wLargeLen = wLength;
+  }
+
+  if (gpphTmlUwb_Context->wRxBufferLen != wSlotLen) {
+    for (int i = 0; i < PH_TMLUWB_RX_SLOT_COUNT; i++) {
+      free(gpphTmlUwb_Context->rxSlots[i].pBuffer);
+      gpphTmlUwb_Context->rxSlots[i].pBuffer = (uint8_t*)malloc(wSlotLen);
+      if (!gpphTmlUwb_Context->rxSlots[i].pBuffer) {
+        gpphTmlUwb_Context->wRxBufferLen = 0;
+        return UWBSTATUS_FAILED;
+      }
+    }
+    gpphTmlUwb_Context->wRxBufferLen = wSlotLen;
+  }
+
+  if (gpphTmlUwb_Context->wRxLargeBufferLen != wLargeLen) {
+    for (int i = 0; i < PH_TMLUWB_RX_LARGE_BUFFER_COUNT; i++) {
+      free(gpphTmlUwb_Context->rxLargeBuffers[i]);
+      gpphTmlUwb_Context->rxLargeBuffers[i] = wLargeLen ? (uint8_t*)malloc(wLargeLen) : NULL;
+      if (wLargeLen && !gpphTmlUwb_Context->rxLargeBuffers[i]) {
+        gpphTmlUwb_Context->wRxLargeBufferLen = 0;
+        return UWBSTATUS_FAILED;
+      }
+    }
+    gpphTmlUwb_Context->wRxLargeBufferLen = wLargeLen;
+  }
+  return UWBSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_StartRead
+**
+** Description      Starts the reader thread which asynchronously reads data
+**                  from the driver.
+**                  Each received packet is stored in one of the
+**                  PH_TMLUWB_RX_SLOT_COUNT slots of the reader ring and
+**                  notified to the upper layer using callback mechanism.
+**                  The reader thread keeps reading ahead as long as a free slot
+**                  is available, a slot is released once its callback returns.
+**
+** Parameters       wLength - size of each RX slot buffer
 **                  pTmlReadComplete - pointer to the function to be invoked
 **                                     upon completion of read operation
 **                  pContext - context provided by upper layer
 **
 ** Returns          UWB status:
-**                  UWBSTATUS_PENDING - command is yet to be processed
+**                  UWBSTATUS_SUCCESS - reader thread started
 **                  UWBSTATUS_INVALID_PARAMETER - at least one parameter is
 **                                                invalid
 **                  UWBSTATUS_BUSY - read request is already in progress
+**                  UWBSTATUS_FAILED - failed to allocate slots or thread
 **
 *******************************************************************************/
-tHAL_UWB_STATUS phTmlUwb_StartRead(uint8_t* pBuffer, uint16_t wLength,
+tHAL_UWB_STATUS phTmlUwb_StartRead(uint16_t wLength,
                         pphTmlUwb_TransactCompletionCb_t pTmlReadComplete,
                         void* pContext)
 {
@@ -510,7 +1281,7 @@ tHAL_UWB_STATUS phTmlUwb_StartRead(uint8_t* pBuffer, uint16_t wLength,
     return PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_NOT_INITIALISED);
   }
 
-  if (!pBuffer || wLength < 1 || !pTmlReadComplete) {
+  if (wLength < 1 || !pTmlReadComplete) {
     return PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_INVALID_PARAMETER);
   }
 
@@ -518,17 +1289,63 @@ tHAL_UWB_STATUS phTmlUwb_StartRead(uint8_t* pBuffer, uint16_t wLength,
     return PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_BUSY);
   }
 
+  if (UWBSTATUS_SUCCESS != phTmlUwb_AllocRxBuffers(wLength)) {
+    return UWBSTATUS_FAILED;
+  }
+
+  /* Deferred call messages are reused for every packet of the slot */
+  for (int i = 0; i < PH_TMLUWB_RX_SLOT_COUNT; i++) {
+    phTmlUwb_RxSlot_t* pSlot = &gpphTmlUwb_Context->rxSlots[i];
+    pSlot->tDeferredInfo.pCallback = &phTmlUwb_ReadDeferredCb;
+    pSlot->tDeferredInfo.pParameter = pSlot;
+    if (!pSlot->pMsg) {
+      pSlot->pMsg = std::make_shared<phLibUwb_Message>(PH_LIBUWB_DEFERREDCALL_MSG,
+                                                       &pSlot->tDeferredInfo);
+    }
+  }
+
   /* Setting the flag marks beginning of a Read Operation */
-  gpphTmlUwb_Context->tReadInfo.pBuffer = pBuffer;
   gpphTmlUwb_Context->tReadInfo.wLength = wLength;
   gpphTmlUwb_Context->tReadInfo.pThread_Callback = pTmlReadComplete;
   gpphTmlUwb_Context->tReadInfo.pContext = pContext;
 
-  /* Set first event to invoke Reader Thread */
-  sem_post(&gpphTmlUwb_Context->rxSemaphore);
+  /* All slots are free, drain leftover posts of a previous reader */
+  while (!sem_trywait(&gpphTmlUwb_Context->rxSemaphore));
+  while (!sem_trywait(&gpphTmlUwb_Context->rxLargeSemaphore));
+  gpphTmlUwb_Context->rxLargeFreeCount = 0;
+  for (int i = 0; i < PH_TMLUWB_RX_LARGE_BUFFER_COUNT; i++) {
+    if (gpphTmlUwb_Context->rxLargeBuffers[i]) {
+      gpphTmlUwb_Context->rxLargeFree[gpphTmlUwb_Context->rxLargeFreeCount++] =
+          gpphTmlUwb_Context->rxLargeBuffers[i];
+      sem_post(&gpphTmlUwb_Context->rxLargeSemaphore);
+    }
+  }
+  for (int i = 0; i < PH_TMLUWB_RX_SLOT_COUNT; i++) {
+    gpphTmlUwb_Context->rxSlots[i].pLargeBuffer = NULL;
+  }
+  gpphTmlUwb_Context->pRxPendingSlot = NULL;
+  gpphTmlUwb_Context->rxFreeHead = 0;
+  gpphTmlUwb_Context->rxFreeCount = PH_TMLUWB_RX_SLOT_COUNT;
+  gpphTmlUwb_Context->rxParkedHead = 0;
+  gpphTmlUwb_Context->rxParkedCount = 0;
+  for (int i = 0; i < PH_TMLUWB_RX_SLOT_COUNT; i++) {
+    gpphTmlUwb_Context->rxFreeSlots[i] = i;
+    sem_post(&gpphTmlUwb_Context->rxSemaphore);
+  }
 
-  /* Create Reader threads */
   gpphTmlUwb_Context->tReadInfo.bThreadShouldStop = false;
+
+  /* The single I/O thread starts polling the device */
+  if (gpphTmlUwb_Context->bSingleIoThread) {
+    if (gpphTmlUwb_Context->bBatchRead) {
+      phTmlUwb_SetNonBlocking(true);
+    }
+    gpphTmlUwb_Context->tReadInfo.bThreadRunning = true;
+    phTmlUwb_KickIoThread();
+    return UWBSTATUS_SUCCESS;
+  }
+
+  /* Create Reader threads */
   int ret = pthread_create(&gpphTmlUwb_Context->readerThread, NULL,
                        &phTmlUwb_TmlReaderThread, NULL);
   if (ret) {
@@ -542,9 +1359,31 @@ void phTmlUwb_StopRead()
 {
   gpphTmlUwb_Context->tReadInfo.bThreadShouldStop = true;
 
-  if (gpphTmlUwb_Context->tReadInfo.bThreadRunning) {
+  // in case the reader waits for a large buffer
+  sem_post(&gpphTmlUwb_Context->rxLargeSemaphore);
+
+  if (gpphTmlUwb_Context->bSingleIoThread) {
+    // The I/O thread never blocks in read(), it disarms the device once woken.
+    // Wait for that, the device may be handed over (e.g. to FW download)
+    // right after.
+    gpphTmlUwb_Context->tReadInfo.bThreadRunning = false;
+    uint32_t dwRxStopReq =
+        gpphTmlUwb_Context->dwRxStopReq.fetch_add(1, std::memory_order_acq_rel) + 1;
+    phTmlUwb_KickIoThread();
+
+    pthread_mutex_lock(&gpphTmlUwb_Context->rxStopLock);
+    while ((int32_t)(gpphTmlUwb_Context->dwRxStopAck - dwRxStopReq) < 0 &&
+           gpphTmlUwb_Context->tWriteInfo.bThreadRunning) {
+      pthread_cond_wait(&gpphTmlUwb_Context->rxStopCond, &gpphTmlUwb_Context->rxStopLock);
+    }
+    pthread_mutex_unlock(&gpphTmlUwb_Context->rxStopLock);
+
+    if (gpphTmlUwb_Context->bBatchRead) {
+      phTmlUwb_SetNonBlocking(false);
+    }
+  } else if (gpphTmlUwb_Context->tReadInfo.bThreadRunning) {
     // to wakeup from blocking read()
-    phTmlUwb_Spi_Ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, ABORT_READ_PENDING);
+    gpphTmlUwb_Context->pTransport->ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, ABORT_READ_PENDING);
     sem_post(&gpphTmlUwb_Context->rxSemaphore);
 
     pthread_join(gpphTmlUwb_Context->readerThread, NULL);
@@ -555,7 +1394,8 @@ void phTmlUwb_StopRead()
 **
 ** Function         phTmlUwb_StartWriterThread
 **
-** Description      start writer thread
+** Description      start writer thread, or the single I/O thread when
+**                  UWB_TML_SINGLE_IO_THREAD is set
 **
 ** Parameters       None
 **
@@ -572,7 +1412,9 @@ static tHAL_UWB_STATUS phTmlUwb_StartWriterThread(void)
 
   /*Start Writer Thread*/
   ret = pthread_create(&gpphTmlUwb_Context->writerThread, NULL,
-                       &phTmlUwb_TmlWriterThread, NULL);
+                       gpphTmlUwb_Context->bSingleIoThread ?
+                           &phTmlUwb_TmlIoThread : &phTmlUwb_TmlWriterThread,
+                       NULL);
   if (ret) {
     return UWBSTATUS_FAILED;
   } else {
@@ -585,7 +1427,7 @@ static tHAL_UWB_STATUS phTmlUwb_StartWriterThread(void)
 **
 ** Function         phTmlUwb_StopWriterThread
 **
-** Description      Stop writer thread
+** Description      Stop writer thread or the single I/O thread
 **
 ** Parameters       None
 **
@@ -594,16 +1436,57 @@ static tHAL_UWB_STATUS phTmlUwb_StartWriterThread(void)
 *******************************************************************************/
 static void phTmlUwb_StopWriterThread(void)
 {
-  gpphTmlUwb_Context->tWriteInfo.bThreadBusy = false;
   gpphTmlUwb_Context->tWriteInfo.bThreadShouldStop = true;
 
   if (gpphTmlUwb_Context->tWriteInfo.bThreadRunning) {
-    sem_post(&gpphTmlUwb_Context->txSemaphore);
+    if (gpphTmlUwb_Context->bSingleIoThread) {
+      phTmlUwb_KickIoThread();
+    } else {
+      sem_post(&gpphTmlUwb_Context->txSemaphore);
+    }
 
     pthread_join(gpphTmlUwb_Context->writerThread, NULL);
   }
 }
 
+/*******************************************************************************
+**
+** Function         phTmlUwb_FlushTxQueue
+**
+** Description      Completes the writer queue entries whose completion has not
+**                  been dispatched, once the writer and client threads are
+**                  stopped. Entries which were not written fail.
+**                  Callers are released with their buffer no longer in use,
+**                  parked RX packets are not delivered anymore.
+**
+** Parameters       None
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_FlushTxQueue(void)
+{
+  pthread_mutex_lock(&gpphTmlUwb_Context->txQueueLock);
+  while (gpphTmlUwb_Context->txCount) {
+    phTmlUwb_TxEntry_t* pEntry = &gpphTmlUwb_Context->txQueue[gpphTmlUwb_Context->txHead];
+    gpphTmlUwb_Context->txHead = (gpphTmlUwb_Context->txHead + 1) % PH_TMLUWB_TX_QUEUE_SIZE;
+    gpphTmlUwb_Context->txCount--;
+    pthread_mutex_unlock(&gpphTmlUwb_Context->txQueueLock);
+
+    if (!pEntry->bWritten) {
+      pEntry->tTransactionInfo.wStatus = PHUWBSTVAL(CID_UWB_TML, UWBSTATUS_FAILED);
+      pEntry->tTransactionInfo.pBuff = const_cast<uint8_t*>(pEntry->pBuffer);
+      pEntry->tTransactionInfo.wLength = 0;
+    }
+    NXPLOG_TML_D("TmlWriter: flushing write of %u bytes", pEntry->wLength);
+    pEntry->pCallback(pEntry->pContext, &pEntry->tTransactionInfo);
+
+    pthread_mutex_lock(&gpphTmlUwb_Context->txQueueLock);
+  }
+  gpphTmlUwb_Context->txWriteIdx = gpphTmlUwb_Context->txHead;
+  pthread_mutex_unlock(&gpphTmlUwb_Context->txQueueLock);
+}
+
 /*******************************************************************************
 **
 ** Function         phTmlUwb_DeferredCall
@@ -611,14 +1494,15 @@ static void phTmlUwb_StopWriterThread(void)
 ** Description      Posts message on upper layer thread
 **                  upon successful read or write operation
 **
-** Parameters       msg - message to be posted
+** Parameters       msg   - message to be posted
+**                  eLane - queue lane, see phLibUwb_MsgLane
 **
 ** Returns          None
 **
 *******************************************************************************/
-void phTmlUwb_DeferredCall(std::shared_ptr<phLibUwb_Message> msg)
+void phTmlUwb_DeferredCall(std::shared_ptr<phLibUwb_Message> msg, phLibUwb_MsgLane eLane)
 {
-  gpphTmlUwb_Context->pClientMq->send(msg);
+  gpphTmlUwb_Context->pClientMq->send(msg, eLane);
 }
 
 /*******************************************************************************
@@ -626,125 +1510,199 @@ void phTmlUwb_DeferredCall(std::shared_ptr<phLibUwb_Message> msg)
 ** Function         phTmlUwb_ReadDeferredCb
 **
 ** Description      Read thread call back function
+**                  A packet read before the completion of the write it may
+**                  answer has been dispatched is parked, together with every
+**                  packet after it, until phTmlUwb_WriteDeferredCb catches up.
+**                  See phTmlUwb_NtfCopyDeferredCb for the notification lane
+**                  overflow policy.
+**                  Called by the reader thread itself, under REENTRANCE_LOCK,
+**                  in inline dispatch mode.
 **
-** Parameters       pParams - context provided by upper layer
+** Parameters       pParams - RX slot filled by the reader thread
 **
 ** Returns          None
 **
 *******************************************************************************/
 static void phTmlUwb_ReadDeferredCb(void* pParams)
 {
-  /* Transaction info buffer to be passed to Callback Function */
-  phTmlUwb_TransactInfo_t* pTransactionInfo = (phTmlUwb_TransactInfo_t*)pParams;
+  /* RX slot holding the transaction info to be passed to Callback Function */
+  phTmlUwb_RxSlot_t* pSlot = (phTmlUwb_RxSlot_t*)pParams;
 
-  /* Reset the flag to accept another Read Request */
-  gpphTmlUwb_Context->tReadInfo.pThread_Callback(
-      gpphTmlUwb_Context->tReadInfo.pContext, pTransactionInfo);
+  phTmlUwb_DispatchRxSlot(pSlot);
+}
 
-  sem_post(&gpphTmlUwb_Context->rxSemaphore);
+/*******************************************************************************
+**
+** Function         phTmlUwb_DispatchRxSlot
+**
+** Description      Parks or delivers a packet, see phTmlUwb_ReadDeferredCb
+**
+** Parameters       pSlot - RX slot filled by the reader thread
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_DispatchRxSlot(phTmlUwb_RxSlot_t* pSlot)
+{
+  if (gpphTmlUwb_Context->rxParkedCount || (pSlot->bOrdered &&
+      (int32_t)(pSlot->dwTxSeq - gpphTmlUwb_Context->txDoneSeq) > 0)) {
+    uint8_t tail = (gpphTmlUwb_Context->rxParkedHead + gpphTmlUwb_Context->rxParkedCount)
+        % PH_TMLUWB_RX_SLOT_COUNT;
+    gpphTmlUwb_Context->rxParked[tail] = pSlot;
+    gpphTmlUwb_Context->rxParkedCount++;
+    NXPLOG_TML_D("TmlReader: packet ahead of write completion %u, parked",
+                 pSlot->dwTxSeq);
+    return;
+  }
+
+  phTmlUwb_DeliverRxSlot(pSlot);
 }
 
 /*******************************************************************************
 **
-** Function         phTmlUwb_WriteDeferredCb
+** Function         phTmlUwb_PostNtfCopy
 **
-** Description      Write thread call back function
+** Description      Copies a bulk notification out of its slot, hands the slot
+**                  back to the reader and posts the copy on the notification
+**                  lane, which can then grow past the RX slot count for the
+**                  overflow policy to apply
 **
-** Parameters       pParams - context provided by upper layer
+** Parameters       pSlot - RX slot filled by the reader thread
 **
 ** Returns          None
 **
 *******************************************************************************/
-static void phTmlUwb_WriteDeferredCb(void* pParams) {
-  /* Transaction info buffer to be passed to Callback Function */
-  phTmlUwb_TransactInfo_t* pTransactionInfo = (phTmlUwb_TransactInfo_t*)pParams;
+static void phTmlUwb_PostNtfCopy(phTmlUwb_RxSlot_t* pSlot)
+{
+  auto pCopy = std::make_shared<phTmlUwb_NtfCopy_t>();
+  const uint8_t* pPacket = pSlot->tTransactionInfo.pBuff;
 
-  /* Reset the flag to accept another Write Request */
-  gpphTmlUwb_Context->tWriteInfo.bThreadBusy = false;
-  gpphTmlUwb_Context->tWriteInfo.pThread_Callback(
-      gpphTmlUwb_Context->tWriteInfo.pContext, pTransactionInfo);
+  pCopy->packet.assign(pPacket, pPacket + pSlot->tTransactionInfo.wLength);
+  pCopy->tTransactionInfo = pSlot->tTransactionInfo;
+  pCopy->tTransactionInfo.pBuff = pCopy->packet.data();
+  pCopy->tDeferredInfo.pCallback = &phTmlUwb_NtfCopyDeferredCb;
+  pCopy->tDeferredInfo.pParameter = pCopy.get();
+  phTmlUwb_ReleaseRxSlot(pSlot);
 
-  return;
+  phTmlUwb_DeferredCall(pCopy, PH_LIBUWB_LANE_NOTIFICATION);
 }
 
 /*******************************************************************************
 **
-** Function         phTmlUwb_WaitWriteComplete
+** Function         phTmlUwb_NtfCopyDeferredCb
 **
-** Description      wait function for reader thread
+** Description      Delivers a notification posted by phTmlUwb_PostNtfCopy, or
+**                  drops it if it is a RANGE_DATA_NTF with at least
+**                  wNtfDropThreshold notifications waiting behind it
 **
-** Parameters       None
+** Parameters       pParams - phTmlUwb_NtfCopy_t, freed with its message
 **
 ** Returns          None
 **
 *******************************************************************************/
-static void phTmlUwb_WaitWriteComplete(void) {
-  int ret;
-  struct timespec absTimeout;
-  if (clock_gettime(CLOCK_MONOTONIC, &absTimeout) == -1) {
-    NXPLOG_TML_E("Reader Thread clock_gettime failed");
-  } else {
-    absTimeout.tv_sec += 1; /*1 second timeout*/
-    gpphTmlUwb_Context->wait_busy_flag = true;
-    NXPLOG_TML_D("phTmlUwb_WaitWriteComplete - enter");
-    ret = pthread_cond_timedwait(&gpphTmlUwb_Context->wait_busy_condition,
-                                 &gpphTmlUwb_Context->wait_busy_lock,
-                                 &absTimeout);
-    if ((ret != 0) && (ret != ETIMEDOUT)) {
-      NXPLOG_TML_E("Reader Thread wait failed");
+static void phTmlUwb_NtfCopyDeferredCb(void* pParams)
+{
+  phTmlUwb_NtfCopy_t* pCopy = (phTmlUwb_NtfCopy_t*)pParams;
+  const uint8_t* pPacket = pCopy->tTransactionInfo.pBuff;
+
+  if ((pPacket[0] & UCI_GID_MASK) == UCI_GID_SESSION_CONTROL &&
+      (pPacket[1] & UCI_OID_MASK) == UCI_OID_RANGE_DATA_NTF &&
+      gpphTmlUwb_Context->pClientMq->pending(PH_LIBUWB_LANE_NOTIFICATION) >=
+          gpphTmlUwb_Context->wNtfDropThreshold) {
+    /* Oldest range data is the least useful */
+    gpphTmlUwb_Context->dwNtfDropped++;
+    if ((gpphTmlUwb_Context->dwNtfDropped % 100) == 1) {
+      NXPLOG_TML_W("TmlReader: notification lane overflow, %u RANGE_DATA_NTF dropped",
+                   gpphTmlUwb_Context->dwNtfDropped);
     }
-    NXPLOG_TML_D("phTmlUwb_WaitWriteComplete - exit");
+    return;
   }
+
+  gpphTmlUwb_Context->tReadInfo.pThread_Callback(
+      gpphTmlUwb_Context->tReadInfo.pContext, &pCopy->tTransactionInfo);
 }
 
 /*******************************************************************************
 **
-** Function         phTmlUwb_SignalWriteComplete
+** Function         phTmlUwb_DeliverRxSlot
 **
-** Description      function to invoke reader thread
+** Description      Invokes the read callback and hands the slot back to the
+**                  reader thread
 **
-** Parameters       None
+** Parameters       pSlot - RX slot filled by the reader thread
 **
 ** Returns          None
 **
 *******************************************************************************/
-static void phTmlUwb_SignalWriteComplete(void) {
-  int ret;
-  if (gpphTmlUwb_Context->wait_busy_flag == true) {
-    NXPLOG_TML_D("phTmlUwb_SignalWriteComplete - enter");
-    gpphTmlUwb_Context->wait_busy_flag = false;
-    ret = pthread_cond_signal(&gpphTmlUwb_Context->wait_busy_condition);
-    if (ret) {
-      NXPLOG_TML_E(" phTmlUwb_SignalWriteComplete failed, error = 0x%X", ret);
-    }
-    NXPLOG_TML_D("phTmlUwb_SignalWriteComplete - exit");
-  }
+static void phTmlUwb_DeliverRxSlot(phTmlUwb_RxSlot_t* pSlot)
+{
+  gpphTmlUwb_Context->tReadInfo.pThread_Callback(
+      gpphTmlUwb_Context->tReadInfo.pContext, &pSlot->tTransactionInfo);
+
+  /* Hand the slot back to the reader thread */
+  phTmlUwb_ReleaseRxSlot(pSlot);
 }
 
 /*******************************************************************************
 **
-** Function         phTmlUwb_WaitReadInit
+** Function         phTmlUwb_WriteDeferredCb
 **
-** Description      init function for reader thread
+** Description      Write thread call back function
+**                  Delivers the RX packets which were waiting for this write
+**                  completion once its callback has returned.
 **
-** Parameters       None
+** Parameters       pParams - writer queue entry which has been written
 **
-** Returns          int
+** Returns          None
 **
 *******************************************************************************/
-static int phTmlUwb_WaitReadInit(void) {
-  int ret;
-  pthread_condattr_t attr;
-  pthread_condattr_init(&attr);
-  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
-  memset(&gpphTmlUwb_Context->wait_busy_condition, 0,
-         sizeof(gpphTmlUwb_Context->wait_busy_condition));
-  pthread_mutex_init(&gpphTmlUwb_Context->wait_busy_lock, NULL);
-  ret = pthread_cond_init(&gpphTmlUwb_Context->wait_busy_condition, &attr);
-  if (ret) {
-    NXPLOG_TML_E(" phTmlUwb_WaitReadInit failed, error = 0x%X", ret);
+static void phTmlUwb_WriteDeferredCb(void* pParams) {
+  /* Queue entry holding the transaction info to be passed to Callback Function */
+  phTmlUwb_TxEntry_t* pEntry = (phTmlUwb_TxEntry_t*)pParams;
+
+  phTmlUwb_DispatchWriteEntry(pEntry);
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_DispatchWriteEntry
+**
+** Description      Releases a written queue entry, invokes its completion
+**                  callback and delivers the packets it was holding back
+**
+** Parameters       pEntry - writer queue entry which has been written
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_DispatchWriteEntry(phTmlUwb_TxEntry_t* pEntry) {
+  pphTmlUwb_TransactCompletionCb_t pCallback = pEntry->pCallback;
+  void* pContext = pEntry->pContext;
+  phTmlUwb_TransactInfo_t tTransactionInfo = pEntry->tTransactionInfo;
+
+  gpphTmlUwb_Context->txDoneSeq = pEntry->dwSeq;
+
+  /* Completions are posted in queue order, release the oldest entry to
+   * accept another Write Request */
+  pthread_mutex_lock(&gpphTmlUwb_Context->txQueueLock);
+  gpphTmlUwb_Context->txHead = (gpphTmlUwb_Context->txHead + 1) % PH_TMLUWB_TX_QUEUE_SIZE;
+  gpphTmlUwb_Context->txCount--;
+  pthread_mutex_unlock(&gpphTmlUwb_Context->txQueueLock);
+
+  pCallback(pContext, &tTransactionInfo);
+
+  while (gpphTmlUwb_Context->rxParkedCount) {
+    phTmlUwb_RxSlot_t* pSlot =
+        gpphTmlUwb_Context->rxParked[gpphTmlUwb_Context->rxParkedHead];
+    if (pSlot->bOrdered &&
+        (int32_t)(pSlot->dwTxSeq - gpphTmlUwb_Context->txDoneSeq) > 0) {
+      break;
+    }
+    gpphTmlUwb_Context->rxParkedHead =
+        (gpphTmlUwb_Context->rxParkedHead + 1) % PH_TMLUWB_RX_SLOT_COUNT;
+    gpphTmlUwb_Context->rxParkedCount--;
+    phTmlUwb_DeliverRxSlot(pSlot);
   }
-  return ret;
 }
 
 /*******************************************************************************
@@ -760,21 +1718,26 @@ static int phTmlUwb_WaitReadInit(void) {
 *******************************************************************************/
 void phTmlUwb_Chip_Reset(void){
   if (NULL != gpphTmlUwb_Context->pDevHandle) {
-    phTmlUwb_Spi_Ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, 0);
+    gpphTmlUwb_Context->pTransport->ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, 0);
     usleep(1000);
-    phTmlUwb_Spi_Ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, 1);
+    gpphTmlUwb_Context->pTransport->ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, 1);
   }
 }
 
 void phTmlUwb_Suspend(void)
 {
   NXPLOG_TML_D("Suspend");
-  phTmlUwb_Spi_Ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, PWR_SUSPEND);
+  gpphTmlUwb_Context->pTransport->ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, PWR_SUSPEND);
 
 }
 
 void phTmlUwb_Resume(void)
 {
   NXPLOG_TML_D("Resume");
-  phTmlUwb_Spi_Ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, PWR_RESUME);
+  gpphTmlUwb_Context->pTransport->ioctl(gpphTmlUwb_Context->pDevHandle, phTmlUwb_ControlCode_t::SetPower, PWR_RESUME);
+}
+
+bool phTmlUwb_IsInlineDispatch(void)
+{
+  return gpphTmlUwb_Context && gpphTmlUwb_Context->bInlineDispatch;
 }
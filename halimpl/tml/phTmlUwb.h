@@ -17,7 +17,9 @@
 #ifndef PHTMLUWB_H
 #define PHTMLUWB_H
 
+#include <atomic>
 #include <memory>
+#include <vector>
 
 #include <phUwbCommon.h>
 #include <phMessageQueue.h>
@@ -39,6 +41,23 @@
  */
 #define PH_TMLUWB_RESETDEVICE (0x00008001)
 
+/*
+ * Number of RX slots the reader thread can fill ahead of the client thread
+ */
+#define PH_TMLUWB_RX_SLOT_COUNT (4)
+
+/*
+ * Framed reads: RX slot buffers hold packets up to this size, larger packets
+ * borrow one of the PH_TMLUWB_RX_LARGE_BUFFER_COUNT large buffers
+ */
+#define PH_TMLUWB_RX_SMALL_BUFFER_LEN (512)
+#define PH_TMLUWB_RX_LARGE_BUFFER_COUNT (2)
+
+/*
+ * Number of write requests which can be queued to the writer thread
+ */
+#define PH_TMLUWB_TX_QUEUE_SIZE (8)
+
 /*
 ***************************Globals,Structure and Enumeration ******************
 */
@@ -94,6 +113,56 @@ typedef struct phTmlUwb_ReadWriteInfo {
   tHAL_UWB_STATUS wWorkStatus; /*Status of the transaction performed */
 } phTmlUwb_ReadWriteInfo_t;
 
+/*
+ * RX slot of the reader ring
+ *
+ * Each slot owns its packet buffer and the callback information posted to
+ * the client thread, so the reader thread can start the next read while
+ * previous packets are still being processed.
+ * read() fills pBuffer directly and the read callback borrows it in place,
+ * the slot is only reused after the callback has returned.
+ */
+typedef struct phTmlUwb_RxSlot {
+  phTmlUwb_TransactInfo_t tTransactionInfo; /* Passed to the read callback */
+  phLibUwb_DeferredCall_t tDeferredInfo;    /* Posted to the client thread */
+  std::shared_ptr<phLibUwb_Message> pMsg;   /* Preallocated deferred call message */
+  uint8_t* pBuffer;                         /* Packet buffer of wRxBufferLen */
+  uint8_t* pLargeBuffer;                    /* Large buffer borrowed for the packet */
+  uint32_t dwTxSeq; /* Last write issued when the packet was read */
+  bool bOrdered;    /* Not a notification, deliver after dwTxSeq completion */
+  bool bBulk;       /* Bulk notification, posted on the notification lane */
+} phTmlUwb_RxSlot_t;
+
+/*
+ * Bulk notification copied out of its RX slot while a notification overflow
+ * policy is set, so that notifications can queue up on the client thread
+ * without holding back the reader. Freed with the message.
+ */
+typedef struct phTmlUwb_NtfCopy : public phLibUwb_Message {
+  phTmlUwb_TransactInfo_t tTransactionInfo; /* Passed to the read callback */
+  phLibUwb_DeferredCall_t tDeferredInfo;    /* Message data */
+  std::vector<uint8_t> packet;
+  phTmlUwb_NtfCopy() : phLibUwb_Message(PH_LIBUWB_DEFERREDCALL_MSG, &tDeferredInfo) {}
+} phTmlUwb_NtfCopy_t;
+
+/*
+ * Entry of the writer queue
+ *
+ * An entry is taken by phTmlUwb_Write() and given back once its completion
+ * callback has been invoked on the client thread.
+ */
+typedef struct phTmlUwb_TxEntry {
+  const uint8_t* pBuffer; /* Buffer to be written, owned by the caller */
+  uint16_t wLength;      /* Length of pBuffer */
+  pphTmlUwb_TransactCompletionCb_t pCallback; /* Write completion callback */
+  void* pContext;        /* Context passed to pCallback */
+  phTmlUwb_TransactInfo_t tTransactionInfo; /* Passed to pCallback */
+  phLibUwb_DeferredCall_t tDeferredInfo;    /* Posted to the client thread */
+  std::shared_ptr<phLibUwb_Message> pMsg;   /* Preallocated deferred call message */
+  uint32_t dwSeq;        /* Sequence number assigned when written */
+  bool bWritten;         /* tTransactionInfo holds the write() result */
+} phTmlUwb_TxEntry_t;
+
 /*
  *Base Context Structure containing members required for entire session
  */
@@ -104,16 +173,78 @@ typedef struct phTmlUwb_Context {
 
   phTmlUwb_ReadWriteInfo_t tReadInfo;  /*Pointer to Reader Thread Structure */
   phTmlUwb_ReadWriteInfo_t tWriteInfo; /*Pointer to Writer Thread Structure */
+  const struct phTmlUwb_Transport* pTransport; /* Link to the UWBS */
   void* pDevHandle;                    /* Pointer to Device Handle */
   std::shared_ptr<MessageQueue<phLibUwb_Message>> pClientMq; /* Pointer to Client thread message queue */
-  sem_t rxSemaphore;
-  sem_t txSemaphore;      /* Lock/Acquire txRx Semaphore */
-
-  pthread_cond_t wait_busy_condition; /*Condition to wait reader thread*/
-  pthread_mutex_t wait_busy_lock;     /*Condition lock to wait reader thread*/
-  volatile uint8_t wait_busy_flag;    /*Condition flag to wait reader thread*/
-  volatile uint8_t gWriterCbflag;    /* flag to indicate write callback message is pushed to
-                           queue*/
+  sem_t rxSemaphore;      /* Counts free RX slots */
+  sem_t txSemaphore;      /* Counts entries queued to the writer thread */
+
+  /* Reader ring: slots are taken from the head of rxFreeSlots by the reader
+   * thread and returned to its tail once the read callback has completed */
+  phTmlUwb_RxSlot_t rxSlots[PH_TMLUWB_RX_SLOT_COUNT];
+  uint16_t wRxBufferLen;
+  uint8_t rxFreeSlots[PH_TMLUWB_RX_SLOT_COUNT];
+  uint8_t rxFreeHead;
+  uint8_t rxFreeCount;
+  pthread_mutex_t rxSlotLock;
+
+  /* Framed reads: the UCI header is read first and sizes the payload read,
+   * packets over wRxBufferLen go to a large buffer of wRxLargeBufferLen */
+  bool bFramedRead;
+  uint16_t wRxLargeBufferLen;
+  uint8_t* rxLargeBuffers[PH_TMLUWB_RX_LARGE_BUFFER_COUNT];
+  uint8_t* rxLargeFree[PH_TMLUWB_RX_LARGE_BUFFER_COUNT]; /* Under rxSlotLock */
+  uint8_t rxLargeFreeCount;
+  sem_t rxLargeSemaphore; /* Counts free large buffers */
+
+  /* Writer queue: entries are queued at txHead + txCount, written from
+   * txWriteIdx and released from txHead once completed */
+  phTmlUwb_TxEntry_t txQueue[PH_TMLUWB_TX_QUEUE_SIZE];
+  uint8_t txHead;
+  uint8_t txCount;
+  uint8_t txWriteIdx;
+  pthread_mutex_t txQueueLock;
+
+  /* Reader/writer ordering: every write() gets the next txSeq, responses
+   * are tagged with the txSeq seen after read() and are only delivered once
+   * the completion of that write has been dispatched on the client thread */
+  std::atomic<uint32_t> txSeq;
+  uint32_t txDoneSeq;     /* Client thread only, or under REENTRANCE_LOCK */
+  phTmlUwb_RxSlot_t* rxParked[PH_TMLUWB_RX_SLOT_COUNT]; /* Same as txDoneSeq */
+  uint8_t rxParkedHead;
+  uint8_t rxParkedCount;
+
+  /* Single I/O thread mode: writerThread runs an epoll loop on the device
+   * and on eventFd, which is signalled for TX submission, RX slot release
+   * and shutdown */
+  bool bSingleIoThread;
+  bool bBatchRead;        /* Non-blocking device, drained on each wakeup */
+  int epollFd;
+  int eventFd;
+  std::atomic<bool> bRxArmed; /* Device is polled for input */
+  uint32_t dwDevEvents;       /* Device events registered, I/O thread only */
+  bool bTxBlocked;            /* Next TX entry taken, write() returned EAGAIN,
+                                 I/O thread only */
+  phTmlUwb_RxSlot_t* pRxPendingSlot; /* Header read, waits for a large
+                                        buffer, I/O thread only */
+  /* phTmlUwb_StopRead() handshake: each stop request is acknowledged once
+   * the I/O thread is out of read() and has disarmed the device */
+  std::atomic<uint32_t> dwRxStopReq;
+  uint32_t dwRxStopAck;       /* Under rxStopLock */
+  pthread_mutex_t rxStopLock;
+  pthread_cond_t rxStopCond;
+
+  /* Notification overflow policy: a RANGE_DATA_NTF is dropped when at least
+   * wNtfDropThreshold newer notifications wait behind it, 0 never drops.
+   * Bulk notifications are posted as phTmlUwb_NtfCopy_t while it is set. */
+  uint16_t wNtfDropThreshold;
+  uint32_t dwNtfDropped;      /* Client thread only */
+
+  /* Inline dispatch: the reader invokes the read callback itself instead of
+   * posting it to the client thread. It holds REENTRANCE_LOCK meanwhile, the
+   * client thread takes it around every message in this mode, which also
+   * guards the ordering state (txDoneSeq, rxParked) */
+  bool bInlineDispatch;
 } phTmlUwb_Context_t;
 
 /*
@@ -130,23 +261,31 @@ enum class phTmlUwb_ControlCode_t {
 };
 
 /* Function declarations */
-tHAL_UWB_STATUS phTmlUwb_Init(const char* pDevName, std::shared_ptr<MessageQueue<phLibUwb_Message>> pClientMq);
+tHAL_UWB_STATUS phTmlUwb_Init(const char* pDevName, phLibUwb_eConfigLinkType eLinkType,
+                              std::shared_ptr<MessageQueue<phLibUwb_Message>> pClientMq);
 tHAL_UWB_STATUS phTmlUwb_Shutdown(void);
 void phTmlUwb_Suspend(void);
 void phTmlUwb_Resume(void);
 
 // Writer: caller should call this for every write io
-tHAL_UWB_STATUS phTmlUwb_Write(uint8_t* pBuffer, uint16_t wLength,
+//         Up to PH_TMLUWB_TX_QUEUE_SIZE writes can be pending, pBuffer must
+//         stay valid until pTmlWriteComplete is called.
+tHAL_UWB_STATUS phTmlUwb_Write(const uint8_t* pBuffer, uint16_t wLength,
                          pphTmlUwb_TransactCompletionCb_t pTmlWriteComplete,
                          void* pContext);
 
 // Reader: caller calls this once, callback will be called for every received packet.
 //         and call StopRead() to unscribe RX packet.
-tHAL_UWB_STATUS phTmlUwb_StartRead(uint8_t* pBuffer, uint16_t wLength,
+//         Packets are delivered from TML owned buffers, up to wLength bytes,
+//         which are only valid during the callback.
+tHAL_UWB_STATUS phTmlUwb_StartRead(uint16_t wLength,
                         pphTmlUwb_TransactCompletionCb_t pTmlReadComplete,
                         void* pContext);
 void phTmlUwb_StopRead();
 
 void phTmlUwb_Chip_Reset(void);
-void phTmlUwb_DeferredCall(std::shared_ptr<phLibUwb_Message> msg);
+// True if read callbacks run on the reader thread, see bInlineDispatch
+bool phTmlUwb_IsInlineDispatch(void);
+void phTmlUwb_DeferredCall(std::shared_ptr<phLibUwb_Message> msg,
+                           phLibUwb_MsgLane eLane = PH_LIBUWB_LANE_CONTROL);
 #endif /*  PHTMLUWB_H  */
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <phNxpLog.h>
+#include <phTmlUwb_transport.h>
+
+/* UWBS side of the socket pair, serviced by an in-process simulator */
+static int gLoopbackPeer = -1;
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_loopback_open
+**
+** Description      Creates the socket pair, pDevName is ignored
+**
+** Parameters       pDevName    - unused
+**                  pLinkHandle - device handle
+**
+** Returns          UWB status:
+**                  UWBSTATUS_SUCCESS - socket pair created
+**                  UWBSTATUS_INVALID_DEVICE - failed to create socket pair
+**
+*******************************************************************************/
+static tHAL_UWB_STATUS phTmlUwb_loopback_open(const char* pDevName, void** pLinkHandle)
+{
+  int sv[2];
+
+  UNUSED(pDevName);
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv)) {
+    NXPLOG_TML_E("_loopback_open() socketpair failed: %d", errno);
+    *pLinkHandle = NULL;
+    return UWBSTATUS_INVALID_DEVICE;
+  }
+
+  gLoopbackPeer = sv[1];
+  *pLinkHandle = (void*)((intptr_t)sv[0]);
+  return UWBSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_loopback_close
+**
+** Description      Closes both ends of the socket pair
+**
+** Parameters       pDevHandle - device handle
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phTmlUwb_loopback_close(void* pDevHandle)
+{
+  phTmlUwb_socket_close(pDevHandle);
+  if (gLoopbackPeer >= 0) {
+    close(gLoopbackPeer);
+    gLoopbackPeer = -1;
+  }
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_loopback_get_peer
+**
+** Description      Returns the UWBS side of the socket pair. UCI packets
+**                  written to it are received by the HAL, commands sent by
+**                  the HAL are read from it.
+**
+** Parameters       None
+**
+** Returns          socket descriptor, -1 if the loopback is not open
+**
+*******************************************************************************/
+int phTmlUwb_loopback_get_peer(void)
+{
+  return gLoopbackPeer;
+}
+
+const phTmlUwb_Transport_t phTmlUwb_LoopbackTransport = {
+  .pName = "loopback",
+  .bStream = true,
+  .open = phTmlUwb_loopback_open,
+  .read = phTmlUwb_socket_read,
+  .write = phTmlUwb_socket_write,
+  .ioctl = phTmlUwb_socket_ioctl,
+  .close = phTmlUwb_loopback_close,
+};
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <phNxpLog.h>
+#include <phTmlUwb_spi.h>
+#include <phTmlUwb_stats.h>
+#include <phTmlUwb_transport.h>
+#include "phNxpUciHal_utils.h"
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_socket_connect_unix
+**
+** Description      Connects to a Unix stream socket
+**
+** Parameters       pPath - socket path, '@' prefix for the abstract namespace
+**
+** Returns          socket descriptor, -1 on failure
+**
+*******************************************************************************/
+static int phTmlUwb_socket_connect_unix(const char* pPath)
+{
+  struct sockaddr_un addr;
+  size_t pathLen = strlen(pPath);
+
+  if (pathLen == 0 || pathLen >= sizeof(addr.sun_path)) {
+    NXPLOG_TML_E("_socket_open() invalid path %s", pPath);
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, pPath, pathLen);
+  if (pPath[0] == '@') {
+    addr.sun_path[0] = '\0';
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr*)&addr, offsetof(struct sockaddr_un, sun_path) + pathLen)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_socket_connect_tcp
+**
+** Description      Connects to a TCP socket
+**
+** Parameters       pHost - host name or address
+**                  pPort - port number
+**
+** Returns          socket descriptor, -1 on failure
+**
+*******************************************************************************/
+static int phTmlUwb_socket_connect_tcp(const char* pHost, const char* pPort)
+{
+  struct addrinfo hints;
+  struct addrinfo* pResult = NULL;
+  int fd = -1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(pHost, pPort, &hints, &pResult)) {
+    return -1;
+  }
+
+  for (struct addrinfo* p = pResult; p != NULL; p = p->ai_next) {
+    fd = socket(p->ai_family, p->ai_socktype | SOCK_CLOEXEC, p->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (!connect(fd, p->ai_addr, p->ai_addrlen)) {
+      /* UCI packets are small and latency matters */
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(pResult);
+  return fd;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_socket_open
+**
+** Description      Connects to a simulated UWBS
+**
+** Parameters       pDevName    - "<host>:<port>" for TCP, otherwise a Unix
+**                                socket path
+**                  pLinkHandle - device handle
+**
+** Returns          UWB status:
+**                  UWBSTATUS_SUCCESS - connected
+**                  UWBSTATUS_INVALID_DEVICE - failed to connect
+**
+*******************************************************************************/
+static tHAL_UWB_STATUS phTmlUwb_socket_open(const char* pDevName, void** pLinkHandle)
+{
+  std::string name(pDevName);
+  size_t colon = name.rfind(':');
+  int fd;
+
+  NXPLOG_TML_D("Connecting to %s\n", pDevName);
+  if (name[0] != '/' && name[0] != '@' && colon != std::string::npos) {
+    fd = phTmlUwb_socket_connect_tcp(name.substr(0, colon).c_str(),
+                                     name.substr(colon + 1).c_str());
+  } else {
+    fd = phTmlUwb_socket_connect_unix(pDevName);
+  }
+
+  if (fd < 0) {
+    NXPLOG_TML_E("_socket_open() Failed to connect %s: %d", pDevName, errno);
+    *pLinkHandle = NULL;
+    return UWBSTATUS_INVALID_DEVICE;
+  }
+
+  *pLinkHandle = (void*)((intptr_t)fd);
+  return UWBSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_socket_recv_all
+**
+** Description      Receives exactly len bytes from a stream socket
+**
+** Returns          len, 0 on orderly shutdown, -1 on failure
+**
+*******************************************************************************/
+static ssize_t phTmlUwb_socket_recv_all(int fd, uint8_t* pBuffer, size_t len)
+{
+  size_t received = 0;
+
+  while (received < len) {
+    ssize_t ret = recv(fd, pBuffer + received, len - received, 0);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && received > 0) {
+      /* Partial packet on a non-blocking socket, the rest is on its way */
+      continue;
+    }
+    if (ret <= 0) {
+      return ret;
+    }
+    received += ret;
+  }
+  return received;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_socket_read
+**
+** Description      Reads exactly nNbBytesToRead bytes from a stream socket.
+**                  Packets are framed by TML from the UCI header.
+**
+** Parameters       pDevHandle       - valid device handle
+**                  pBuffer          - buffer for read data
+**                  nNbBytesToRead   - number of bytes to read
+**
+** Returns          numRead   - nNbBytesToRead
+**                  0         - connection closed
+**                  -1        - read operation failure
+**
+*******************************************************************************/
+int phTmlUwb_socket_read(void* pDevHandle, uint8_t* pBuffer, size_t nNbBytesToRead)
+{
+  if (NULL == pDevHandle) {
+    return -1;
+  }
+
+  ssize_t ret = phTmlUwb_socket_recv_all((intptr_t)pDevHandle, pBuffer, nNbBytesToRead);
+  if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    NXPLOG_TML_E("_socket_read() error: %d", errno);
+  }
+  return ret;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_socket_write
+**
+** Description      Writes one UCI packet to a stream socket
+**
+** Parameters       pDevHandle       - valid device handle
+**                  pBuffer          - buffer to be written
+**                  nNbBytesToWrite  - number of bytes requested to be written
+**
+** Returns          numWrote   - number of successfully written bytes
+**                  -1         - write operation failure
+**
+*******************************************************************************/
+int phTmlUwb_socket_write(void* pDevHandle, const uint8_t* pBuffer, size_t nNbBytesToWrite)
+{
+  int fd = (intptr_t)pDevHandle;
+  size_t sent = 0;
+
+  if (NULL == pDevHandle || nNbBytesToWrite == 0) {
+    return -1;
+  }
+
+  while (sent < nNbBytesToWrite) {
+    ssize_t ret = send(fd, pBuffer + sent, nNbBytesToWrite - sent, MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+        continue;
+      }
+      NXPLOG_TML_E("_socket_write() failed: %d", errno);
+      return -1;
+    }
+    sent += ret;
+  }
+  return sent;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_socket_ioctl
+**
+** Description      There are no power or firmware download controls on a
+**                  socket. Aborting a pending read shuts the receive side
+**                  down to wake up the reader thread.
+**
+** Parameters       pDevHandle     - valid device handle
+**                  eControlCode   - control code
+**                  arg            - control argument
+**
+** Returns           1   - success
+**                  -1   - failure
+**
+*******************************************************************************/
+int phTmlUwb_socket_ioctl(void* pDevHandle, phTmlUwb_ControlCode_t eControlCode, long arg)
+{
+  if (NULL == pDevHandle) {
+    return -1;
+  }
+  if (eControlCode == phTmlUwb_ControlCode_t::SetPower && arg == ABORT_READ_PENDING) {
+    shutdown((intptr_t)pDevHandle, SHUT_RD);
+  } else if (eControlCode == phTmlUwb_ControlCode_t::EnableThroughPut) {
+    phTmlUwb_Stats_Enable(arg != 0);
+  }
+  return 1;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_socket_close
+**
+** Description      Closes the socket
+**
+** Parameters       pDevHandle - device handle
+**
+** Returns          None
+**
+*******************************************************************************/
+void phTmlUwb_socket_close(void* pDevHandle)
+{
+  if (NULL != pDevHandle) {
+    close((intptr_t)pDevHandle);
+  }
+}
+
+const phTmlUwb_Transport_t phTmlUwb_SocketTransport = {
+  .pName = "socket",
+  .bStream = true,
+  .open = phTmlUwb_socket_open,
+  .read = phTmlUwb_socket_read,
+  .write = phTmlUwb_socket_write,
+  .ioctl = phTmlUwb_socket_ioctl,
+  .close = phTmlUwb_socket_close,
+};
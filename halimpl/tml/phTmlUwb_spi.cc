@@ -24,6 +24,8 @@
 #include <phUwbStatus.h>
 #include <phNxpLog.h>
 #include <phTmlUwb_spi.h>
+#include <phTmlUwb_stats.h>
+#include <phTmlUwb_transport.h>
 #include <string.h>
 #include "phNxpUciHal_utils.h"
 #include "phNxpUciHal.h"
@@ -78,7 +80,7 @@ tHAL_UWB_STATUS phTmlUwb_spi_open_and_configure(const char* pDevName, void** pLi
 **                  -1         - write operation failure
 **
 *******************************************************************************/
-int phTmlUwb_spi_write(void* pDevHandle, uint8_t* pBuffer, size_t nNbBytesToWrite)
+int phTmlUwb_spi_write(void* pDevHandle, const uint8_t* pBuffer, size_t nNbBytesToWrite)
 {
   int ret;
   ssize_t numWrote;
@@ -95,7 +97,9 @@ int phTmlUwb_spi_write(void* pDevHandle, uint8_t* pBuffer, size_t nNbBytesToWrit
 
   numWrote = write((intptr_t)pDevHandle, pBuffer, nNbBytesToWrite);
   if (numWrote == -1) {
-    NXPLOG_TML_E("_spi_write() failed: %d", errno);
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      NXPLOG_TML_E("_spi_write() failed: %d", errno);
+    }
     return -1;
   } else if (numWrote != nNbBytesToWrite) {
     NXPLOG_TML_E("_spi_write() size mismatch %zd != %zd", nNbBytesToWrite, numWrote);
@@ -130,7 +134,9 @@ int phTmlUwb_spi_read(void* pDevHandle, uint8_t* pBuffer, size_t nNbBytesToRead)
 
   ret_Read = read((intptr_t)pDevHandle, pBuffer, nNbBytesToRead);
   if (ret_Read == -1) {
-     NXPLOG_TML_E("_spi_read() error: %d", errno);
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      NXPLOG_TML_E("_spi_read() error: %d", errno);
+    }
   } else if((nxpucihal_ctrl.fw_dwnld_mode) && ((0xFF == pBuffer[0]) || ((0x00 == pBuffer[0]) && (0x00 == pBuffer[3])))) {
       NXPLOG_TML_E("_spi_read() error: Invalid UCI packet");
       /* To Avoid spurious interrupt after FW download */
@@ -167,7 +173,8 @@ int phTmlUwb_Spi_Ioctl(void* pDevHandle, phTmlUwb_ControlCode_t eControlCode , l
       ioctl((intptr_t)pDevHandle, SRXXX_SET_FWD, arg);
       break;
     case phTmlUwb_ControlCode_t::EnableThroughPut:
-      //ioctl((intptr_t)pDevHandle, SRXXX_GET_THROUGHPUT, arg);
+      /* Measured in user space, see phTmlUwb_stats.h */
+      phTmlUwb_Stats_Enable(arg != 0);
       break;
     case phTmlUwb_ControlCode_t::EseReset:
       ioctl((intptr_t)pDevHandle, SRXXX_ESE_RESET, arg);
@@ -197,3 +204,13 @@ void phTmlUwb_spi_close(void* pDevHandle) {
 
   return;
 }
+
+const phTmlUwb_Transport_t phTmlUwb_SpiTransport = {
+  .pName = "spi",
+  .bStream = false,
+  .open = phTmlUwb_spi_open_and_configure,
+  .read = phTmlUwb_spi_read,
+  .write = phTmlUwb_spi_write,
+  .ioctl = phTmlUwb_Spi_Ioctl,
+  .close = phTmlUwb_spi_close,
+};
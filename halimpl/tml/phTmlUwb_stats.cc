@@ -0,0 +1,297 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <time.h>
+
+#include <atomic>
+
+#include <phNxpLog.h>
+#include <phTmlUwb_stats.h>
+
+/* Counters of one direction, updated with atomic RMWs so that a concurrent
+ * reset or a second io thread doesn't lose or resurrect counts */
+struct phTmlUwb_DirCounters {
+  std::atomic<uint64_t> packets;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> errors;
+  std::atomic<uint64_t> busyNs;
+  std::atomic<uint64_t> maxNs;
+};
+
+static std::atomic<bool> gStatsEnabled;
+static std::atomic<uint64_t> gStatsResetNs;
+static phTmlUwb_DirCounters gRx;
+static phTmlUwb_DirCounters gTx;
+static std::atomic<uint64_t> gRxSizeHist[PH_TMLUWB_STATS_SIZE_BUCKETS];
+static std::atomic<pphTmlUwb_StatsDumpCb_t> gStatsDumpCb;
+
+static uint64_t phTmlUwb_Stats_Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void phTmlUwb_Stats_Add(std::atomic<uint64_t>& counter, uint64_t value)
+{
+  counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+static void phTmlUwb_Stats_Max(std::atomic<uint64_t>& counter, uint64_t value)
+{
+  uint64_t cur = counter.load(std::memory_order_relaxed);
+  while (value > cur &&
+         !counter.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+  }
+}
+
+static void phTmlUwb_Stats_Account(phTmlUwb_DirCounters& dir, uint64_t startNs, ssize_t ret)
+{
+  uint64_t durationNs = phTmlUwb_Stats_Now() - startNs;
+
+  if (ret > 0) {
+    phTmlUwb_Stats_Add(dir.packets, 1);
+    phTmlUwb_Stats_Add(dir.bytes, ret);
+  } else {
+    phTmlUwb_Stats_Add(dir.errors, 1);
+  }
+  phTmlUwb_Stats_Add(dir.busyNs, durationNs);
+  phTmlUwb_Stats_Max(dir.maxNs, durationNs);
+}
+
+static void phTmlUwb_Stats_GetDir(phTmlUwb_DirCounters& dir, phTmlUwb_DirStats_t* pStats)
+{
+  pStats->packets = dir.packets.load(std::memory_order_relaxed);
+  pStats->bytes = dir.bytes.load(std::memory_order_relaxed);
+  pStats->errors = dir.errors.load(std::memory_order_relaxed);
+  pStats->busyNs = dir.busyNs.load(std::memory_order_relaxed);
+  pStats->maxNs = dir.maxNs.load(std::memory_order_relaxed);
+}
+
+static void phTmlUwb_Stats_ResetDir(phTmlUwb_DirCounters& dir)
+{
+  dir.packets = 0;
+  dir.bytes = 0;
+  dir.errors = 0;
+  dir.busyNs = 0;
+  dir.maxNs = 0;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_Stats_Enable
+**
+** Description      Starts the meter from zero, or stops it and logs the
+**                  counters collected so far
+**
+** Parameters       bEnable - start or stop measuring
+**
+** Returns          None
+**
+*******************************************************************************/
+void phTmlUwb_Stats_Enable(bool bEnable)
+{
+  if (bEnable) {
+    phTmlUwb_Stats_Reset();
+    gStatsEnabled = true;
+  } else if (gStatsEnabled) {
+    gStatsEnabled = false;
+    phTmlUwb_Stats_Dump();
+  }
+}
+
+bool phTmlUwb_Stats_IsEnabled(void)
+{
+  return gStatsEnabled;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_Stats_Reset
+**
+** Description      Clears all counters
+**
+** Parameters       None
+**
+** Returns          None
+**
+*******************************************************************************/
+void phTmlUwb_Stats_Reset(void)
+{
+  phTmlUwb_Stats_ResetDir(gRx);
+  phTmlUwb_Stats_ResetDir(gTx);
+  for (int i = 0; i < PH_TMLUWB_STATS_SIZE_BUCKETS; i++) {
+    gRxSizeHist[i] = 0;
+  }
+  gStatsResetNs = phTmlUwb_Stats_Now();
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_Stats_Get
+**
+** Description      Takes a snapshot of the counters
+**
+** Parameters       pStats - filled with the counters since the last reset
+**
+** Returns          None
+**
+*******************************************************************************/
+void phTmlUwb_Stats_Get(phTmlUwb_Stats_t* pStats)
+{
+  pStats->elapsedNs = phTmlUwb_Stats_Now() - gStatsResetNs.load();
+  phTmlUwb_Stats_GetDir(gRx, &pStats->rx);
+  phTmlUwb_Stats_GetDir(gTx, &pStats->tx);
+  for (int i = 0; i < PH_TMLUWB_STATS_SIZE_BUCKETS; i++) {
+    pStats->rxSizeHist[i] = gRxSizeHist[i].load(std::memory_order_relaxed);
+  }
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_Stats_Dump
+**
+** Description      Logs the counters with per-second rates
+**
+** Parameters       None
+**
+** Returns          None
+**
+*******************************************************************************/
+void phTmlUwb_Stats_Dump(void)
+{
+  phTmlUwb_Stats_t stats;
+  phTmlUwb_Stats_Get(&stats);
+
+  uint64_t elapsedMs = stats.elapsedNs / 1000000;
+  if (!elapsedMs) {
+    elapsedMs = 1;
+  }
+  const struct {
+    const char* pName;
+    const phTmlUwb_DirStats_t* pDir;
+  } dirs[] = { { "RX", &stats.rx }, { "TX", &stats.tx } };
+
+  NXPLOG_TML_D("TML stats over %llu ms", (unsigned long long)elapsedMs);
+  for (const auto& dir : dirs) {
+    uint64_t calls = dir.pDir->packets + dir.pDir->errors;
+    NXPLOG_TML_D("  %s: %llu pkts (%llu pkt/s), %llu bytes (%llu B/s), %llu errors, "
+                 "syscall avg %llu us max %llu us, busy %llu%%",
+                 dir.pName,
+                 (unsigned long long)dir.pDir->packets,
+                 (unsigned long long)(dir.pDir->packets * 1000 / elapsedMs),
+                 (unsigned long long)dir.pDir->bytes,
+                 (unsigned long long)(dir.pDir->bytes * 1000 / elapsedMs),
+                 (unsigned long long)dir.pDir->errors,
+                 (unsigned long long)(calls ? dir.pDir->busyNs / calls / 1000 : 0),
+                 (unsigned long long)(dir.pDir->maxNs / 1000),
+                 (unsigned long long)(dir.pDir->busyNs / 10000 / elapsedMs));
+  }
+  NXPLOG_TML_D("  RX sizes <=16:%llu <=32:%llu <=64:%llu <=128:%llu <=256:%llu "
+               "<=512:%llu <=1K:%llu <=2K:%llu >2K:%llu",
+               (unsigned long long)stats.rxSizeHist[0], (unsigned long long)stats.rxSizeHist[1],
+               (unsigned long long)stats.rxSizeHist[2], (unsigned long long)stats.rxSizeHist[3],
+               (unsigned long long)stats.rxSizeHist[4], (unsigned long long)stats.rxSizeHist[5],
+               (unsigned long long)stats.rxSizeHist[6], (unsigned long long)stats.rxSizeHist[7],
+               (unsigned long long)stats.rxSizeHist[8]);
+
+  pphTmlUwb_StatsDumpCb_t pDumpCb = gStatsDumpCb.load();
+  if (pDumpCb) {
+    pDumpCb();
+  }
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_Stats_SetDumpCb
+**
+** Description      Registers the function logging the statistics of the
+**                  upper layers along with the TML counters
+**
+** Parameters       pDumpCb - dump function, NULL to unregister
+**
+** Returns          None
+**
+*******************************************************************************/
+void phTmlUwb_Stats_SetDumpCb(pphTmlUwb_StatsDumpCb_t pDumpCb)
+{
+  gStatsDumpCb = pDumpCb;
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_Stats_Begin
+**
+** Description      Timestamps the start of a transport read()/write()
+**
+** Parameters       None
+**
+** Returns          start time, 0 if the meter is disabled
+**
+*******************************************************************************/
+uint64_t phTmlUwb_Stats_Begin(void)
+{
+  if (!gStatsEnabled.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+  return phTmlUwb_Stats_Now();
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_Stats_EndRead
+**
+** Description      Accounts a transport read()
+**
+** Parameters       startNs - value returned by phTmlUwb_Stats_Begin()
+**                  ret     - return value of read()
+**
+** Returns          None
+**
+*******************************************************************************/
+void phTmlUwb_Stats_EndRead(uint64_t startNs, ssize_t ret)
+{
+  if (!startNs) {
+    return;
+  }
+  phTmlUwb_Stats_Account(gRx, startNs, ret);
+  if (ret > 0) {
+    int bucket = 0;
+    while (bucket < PH_TMLUWB_STATS_SIZE_BUCKETS - 1 && ret > (16 << bucket)) {
+      bucket++;
+    }
+    phTmlUwb_Stats_Add(gRxSizeHist[bucket], 1);
+  }
+}
+
+/*******************************************************************************
+**
+** Function         phTmlUwb_Stats_EndWrite
+**
+** Description      Accounts a transport write()
+**
+** Parameters       startNs - value returned by phTmlUwb_Stats_Begin()
+**                  ret     - return value of write()
+**
+** Returns          None
+**
+*******************************************************************************/
+void phTmlUwb_Stats_EndWrite(uint64_t startNs, ssize_t ret)
+{
+  if (!startNs) {
+    return;
+  }
+  phTmlUwb_Stats_Account(gTx, startNs, ret);
+}
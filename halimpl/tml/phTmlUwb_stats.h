@@ -0,0 +1,68 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PHTMLUWB_STATS_H
+#define PHTMLUWB_STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Throughput meter of the TML layer
+ *
+ * Counts packets and bytes per direction, the time spent in the transport
+ * read()/write() calls and the distribution of read sizes. It is disabled by
+ * default: UWB_TML_STATS_ENABLE turns it on at TML init, and the
+ * EnableThroughPut control code turns it on (arg=1, counters are reset) or
+ * off (arg=0, counters are logged) at runtime.
+ * Upper layers can add their own statistics to the log with
+ * phTmlUwb_Stats_SetDumpCb().
+ */
+
+/* Read size buckets: <=16, <=32, <=64, ... <=2048, >2048 bytes */
+#define PH_TMLUWB_STATS_SIZE_BUCKETS (9)
+
+typedef struct phTmlUwb_DirStats {
+  uint64_t packets;       /* Successful transfers */
+  uint64_t bytes;         /* Bytes transferred */
+  uint64_t errors;        /* Failed calls */
+  uint64_t busyNs;        /* Total time spent in read()/write() */
+  uint64_t maxNs;         /* Longest read()/write() */
+} phTmlUwb_DirStats_t;
+
+typedef struct phTmlUwb_Stats {
+  uint64_t elapsedNs;     /* Time since the last reset */
+  phTmlUwb_DirStats_t rx;
+  phTmlUwb_DirStats_t tx;
+  uint64_t rxSizeHist[PH_TMLUWB_STATS_SIZE_BUCKETS];
+} phTmlUwb_Stats_t;
+
+void phTmlUwb_Stats_Enable(bool bEnable);
+bool phTmlUwb_Stats_IsEnabled(void);
+void phTmlUwb_Stats_Reset(void);
+void phTmlUwb_Stats_Get(phTmlUwb_Stats_t* pStats);
+void phTmlUwb_Stats_Dump(void);
+
+/* Called at the end of phTmlUwb_Stats_Dump(), NULL to unregister */
+typedef void (*pphTmlUwb_StatsDumpCb_t)(void);
+void phTmlUwb_Stats_SetDumpCb(pphTmlUwb_StatsDumpCb_t pDumpCb);
+
+/* Called around transport read()/write(): Begin() returns 0 when disabled */
+uint64_t phTmlUwb_Stats_Begin(void);
+void phTmlUwb_Stats_EndRead(uint64_t startNs, ssize_t ret);
+void phTmlUwb_Stats_EndWrite(uint64_t startNs, ssize_t ret);
+
+#endif /* PHTMLUWB_STATS_H */
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2024 NXP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PHTMLUWB_TRANSPORT_H
+#define PHTMLUWB_TRANSPORT_H
+
+#include <phUwbTypes.h>
+#include <phTmlUwb.h>
+
+/*
+ * Transport used by TML to exchange UCI packets with the UWBS
+ *
+ * A packet transport returns exactly one UCI packet per read(). A stream
+ * transport (bStream) returns exactly the number of bytes requested, TML
+ * reads the UCI header first and then its payload.
+ * The link handle is a file descriptor cast to void*, it is also polled by
+ * the single I/O thread and used directly by the firmware download path.
+ */
+typedef struct phTmlUwb_Transport {
+  const char* pName;
+  bool bStream;
+  tHAL_UWB_STATUS (*open)(const char* pDevName, void** pLinkHandle);
+  int (*read)(void* pDevHandle, uint8_t* pBuffer, size_t nNbBytesToRead);
+  int (*write)(void* pDevHandle, const uint8_t* pBuffer, size_t nNbBytesToWrite);
+  int (*ioctl)(void* pDevHandle, phTmlUwb_ControlCode_t eControlCode, long arg);
+  void (*close)(void* pDevHandle);
+} phTmlUwb_Transport_t;
+
+/* SPI character device, pDevName is the device node (default) */
+extern const phTmlUwb_Transport_t phTmlUwb_SpiTransport;
+
+/* Stream socket to a simulated UWBS, pDevName is "<host>:<port>" for TCP or
+ * a Unix socket path, '@' prefix for the abstract namespace */
+extern const phTmlUwb_Transport_t phTmlUwb_SocketTransport;
+
+/* In-process socket pair, the UWBS side is phTmlUwb_loopback_get_peer() */
+extern const phTmlUwb_Transport_t phTmlUwb_LoopbackTransport;
+
+const phTmlUwb_Transport_t* phTmlUwb_GetTransport(phLibUwb_eConfigLinkType eLinkType);
+
+/* Socket helpers shared by the socket and loopback transports */
+int phTmlUwb_socket_read(void* pDevHandle, uint8_t* pBuffer, size_t nNbBytesToRead);
+int phTmlUwb_socket_write(void* pDevHandle, const uint8_t* pBuffer, size_t nNbBytesToWrite);
+int phTmlUwb_socket_ioctl(void* pDevHandle, phTmlUwb_ControlCode_t eControlCode, long arg);
+void phTmlUwb_socket_close(void* pDevHandle);
+
+int phTmlUwb_loopback_get_peer(void);
+
+#endif /* PHTMLUWB_TRANSPORT_H */
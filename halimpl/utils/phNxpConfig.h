@@ -81,6 +81,26 @@ int NxpConfig_GetStrArrayVal(const char* name, int index, char* pValue, unsigned
 
 #define NAME_DELETE_URSK_FOR_CCC_SESSION    "DELETE_URSK_FOR_CCC_SESSION"
 
+#define NAME_UWB_TML_SINGLE_IO_THREAD   "UWB_TML_SINGLE_IO_THREAD"
+#define NAME_UWB_TML_LINK_TYPE          "UWB_TML_LINK_TYPE"
+#define NAME_UWB_TML_DEVICE_NODE        "UWB_TML_DEVICE_NODE"
+#define NAME_UWB_TML_FRAMED_READ        "UWB_TML_FRAMED_READ"
+#define NAME_UWB_TML_INLINE_DISPATCH    "UWB_TML_INLINE_DISPATCH"
+#define NAME_UWB_TML_STATS_ENABLE       "UWB_TML_STATS_ENABLE"
+#define NAME_UWB_NTF_DROP_THRESHOLD     "UWB_NTF_DROP_THRESHOLD"
+#define NAME_UWB_CLIENT_BURST_DRAIN     "UWB_CLIENT_BURST_DRAIN"
+#define NAME_UWB_RT_PROFILE             "UWB_RT_PROFILE"
+#define NAME_UWB_RT_THREAD_PRIORITY     "UWB_RT_THREAD_PRIORITY"
+#define NAME_UWB_RT_THREAD_AFFINITY     "UWB_RT_THREAD_AFFINITY"
+#define NAME_UWB_DATA_TX_SCHEDULER      "UWB_DATA_TX_SCHEDULER"
+#define NAME_UWB_DATA_TX_QUEUE_DEPTH    "UWB_DATA_TX_QUEUE_DEPTH"
+#define NAME_UWB_RSP_TIMEOUT_MS         "UWB_RSP_TIMEOUT_MS"
+#define NAME_UWB_RSP_TIMEOUT_TABLE      "UWB_RSP_TIMEOUT_TABLE"
+#define NAME_UWB_RSP_TIMEOUT_ADAPTIVE   "UWB_RSP_TIMEOUT_ADAPTIVE"
+#define NAME_UWB_RSP_TIMEOUT_MIN_MS     "UWB_RSP_TIMEOUT_MIN_MS"
+#define NAME_UWB_CMD_RETRY_COUNT        "UWB_CMD_RETRY_COUNT"
+#define NAME_UWB_CMD_RETRY_BACKOFF_MS   "UWB_CMD_RETRY_BACKOFF_MS"
+
 /* default configuration */
 #define default_storage_location "/data/vendor/uwb"
 
@@ -25,18 +25,18 @@ using namespace std;
 map<uint16_t, vector<uint16_t>> input_map;
 map<uint16_t, vector<uint16_t>> conf_map;
 
-/*********************** Link list functions **********************************/
+/******************** Semaphore list functions *********************************/
 
 /*******************************************************************************
 **
-** Function         listInit
+** Function         semListInit
 **
-** Description      List initialization
+** Description      Semaphore list initialization
 **
 ** Returns          1, if list initialized, 0 otherwise
 **
 *******************************************************************************/
-int listInit(struct listHead* pList) {
+static int semListInit(struct phNxpUciHal_SemList* pList) {
   pList->pFirst = NULL;
   if (pthread_mutex_init(&pList->mutex, NULL) == -1) {
     NXPLOG_UCIHAL_E("Mutex creation failed (errno=0x%08x)", errno);
@@ -48,18 +48,23 @@ int listInit(struct listHead* pList) {
 
 /*******************************************************************************
 **
-** Function         listDestroy
+** Function         semListDestroy
 **
-** Description      List destruction
+** Description      Semaphore list destruction, nodes are owned by the callers
+**                  and are only unlinked
 **
 ** Returns          1, if list destroyed, 0 if failed
 **
 *******************************************************************************/
-int listDestroy(struct listHead* pList) {
-  int bListNotEmpty = 1;
-  while (bListNotEmpty) {
-    bListNotEmpty = listGetAndRemoveNext(pList, NULL);
+static int semListDestroy(struct phNxpUciHal_SemList* pList) {
+  pthread_mutex_lock(&pList->mutex);
+  while (pList->pFirst != NULL) {
+    phNxpUciHal_Sem_t* pNode = pList->pFirst;
+    pList->pFirst = pNode->pNext;
+    pNode->pPrev = pNode->pNext = NULL;
+    pNode->bRegistered = false;
   }
+  pthread_mutex_unlock(&pList->mutex);
 
   if (pthread_mutex_destroy(&pList->mutex) == -1) {
     NXPLOG_UCIHAL_E("Mutex destruction failed (errno=0x%08x)", errno);
@@ -71,178 +76,56 @@ int listDestroy(struct listHead* pList) {
 
 /*******************************************************************************
 **
-** Function         listAdd
+** Function         semListAdd
 **
-** Description      Add a node to the list
+** Description      Add a node at the head of the list, O(1)
 **
-** Returns          1, if added, 0 if otherwise
+** Returns          None
 **
 *******************************************************************************/
-int listAdd(struct listHead* pList, void* pData) {
-  struct listNode* pNode;
-  struct listNode* pLastNode;
-  int result;
-
-  /* Create node */
-  pNode = (struct listNode*)malloc(sizeof(struct listNode));
-  if (pNode == NULL) {
-    result = 0;
-    NXPLOG_UCIHAL_E("Failed to malloc");
-    goto clean_and_return;
-  }
-  pNode->pData = pData;
-  pNode->pNext = NULL;
+static void semListAdd(struct phNxpUciHal_SemList* pList,
+                       phNxpUciHal_Sem_t* pNode) {
   pthread_mutex_lock(&pList->mutex);
-
-  /* Add the node to the list */
-  if (pList->pFirst == NULL) {
-    /* Set the node as the head */
-    pList->pFirst = pNode;
-  } else {
-    /* Seek to the end of the list */
-    pLastNode = pList->pFirst;
-    while (pLastNode->pNext != NULL) {
-      pLastNode = pLastNode->pNext;
-    }
-
-    /* Add the node to the current list */
-    pLastNode->pNext = pNode;
+  pNode->pPrev = NULL;
+  pNode->pNext = pList->pFirst;
+  if (pList->pFirst != NULL) {
+    pList->pFirst->pPrev = pNode;
   }
-
-  result = 1;
-
-clean_and_return:
+  pList->pFirst = pNode;
+  pNode->bRegistered = true;
   pthread_mutex_unlock(&pList->mutex);
-  return result;
 }
 
 /*******************************************************************************
 **
-** Function         listRemove
+** Function         semListRemove
 **
-** Description      Remove node from the list
+** Description      Unlink a node from the list, O(1). A node which was already
+**                  unlinked (e.g. by phNxpUciHal_releaseall_cb_data) is left
+**                  untouched.
 **
-** Returns          1, if removed, 0 if otherwise
+** Returns          None
 **
 *******************************************************************************/
-int listRemove(struct listHead* pList, void* pData) {
-  struct listNode* pNode;
-  struct listNode* pRemovedNode;
-  int result;
-
+static void semListRemove(struct phNxpUciHal_SemList* pList,
+                          phNxpUciHal_Sem_t* pNode) {
   pthread_mutex_lock(&pList->mutex);
-
-  if (pList->pFirst == NULL) {
-    /* Empty list */
-    NXPLOG_UCIHAL_E("Failed to deallocate (list empty)");
-    result = 0;
-    goto clean_and_return;
-  }
-
-  pNode = pList->pFirst;
-  if (pList->pFirst->pData == pData) {
-    /* Get the removed node */
-    pRemovedNode = pNode;
-
-    /* Remove the first node */
-    pList->pFirst = pList->pFirst->pNext;
-  } else {
-    while (pNode->pNext != NULL) {
-      if (pNode->pNext->pData == pData) {
-        /* Node found ! */
-        break;
-      }
-      pNode = pNode->pNext;
+  if (pNode->bRegistered) {
+    if (pNode->pPrev != NULL) {
+      pNode->pPrev->pNext = pNode->pNext;
+    } else {
+      pList->pFirst = pNode->pNext;
     }
-
-    if (pNode->pNext == NULL) {
-      /* Node not found */
-      result = 0;
-      NXPLOG_UCIHAL_E("Failed to deallocate (not found %8p)", pData);
-      goto clean_and_return;
+    if (pNode->pNext != NULL) {
+      pNode->pNext->pPrev = pNode->pPrev;
     }
-
-    /* Get the removed node */
-    pRemovedNode = pNode->pNext;
-
-    /* Remove the node from the list */
-    pNode->pNext = pNode->pNext->pNext;
-  }
-
-  /* Deallocate the node */
-  free(pRemovedNode);
-
-  result = 1;
-
-clean_and_return:
-  pthread_mutex_unlock(&pList->mutex);
-  return result;
-}
-
-/*******************************************************************************
-**
-** Function         listGetAndRemoveNext
-**
-** Description      Get next node on the list and remove it
-**
-** Returns          1, if successful, 0 if otherwise
-**
-*******************************************************************************/
-int listGetAndRemoveNext(struct listHead* pList, void** ppData) {
-  struct listNode* pNode;
-  int result;
-
-  pthread_mutex_lock(&pList->mutex);
-
-  if (pList->pFirst == NULL) {
-    /* Empty list */
-    NXPLOG_UCIHAL_D("Failed to deallocate (list empty)");
-    result = 0;
-    goto clean_and_return;
+    pNode->pPrev = pNode->pNext = NULL;
+    pNode->bRegistered = false;
   }
-
-  /* Work on the first node */
-  pNode = pList->pFirst;
-
-  /* Return the data */
-  if (ppData != NULL) {
-    *ppData = pNode->pData;
-  }
-
-  /* Remove and deallocate the node */
-  pList->pFirst = pNode->pNext;
-  free(pNode);
-
-  result = 1;
-
-clean_and_return:
-  listDump(pList);
   pthread_mutex_unlock(&pList->mutex);
-  return result;
-}
-
-/*******************************************************************************
-**
-** Function         listDump
-**
-** Description      Dump list information
-**
-** Returns          None
-**
-*******************************************************************************/
-void listDump(struct listHead* pList) {
-  struct listNode* pNode = pList->pFirst;
-
-  NXPLOG_UCIHAL_D("Node dump:");
-  while (pNode != NULL) {
-    NXPLOG_UCIHAL_D("- %8p (%8p)", pNode, pNode->pData);
-    pNode = pNode->pNext;
-  }
-
-  return;
 }
 
-/* END Linked list source code */
+/* END Semaphore list functions */
 
 /****************** Semaphore and mutex helper functions **********************/
 
@@ -279,7 +162,7 @@ phNxpUciHal_Monitor_t* phNxpUciHal_init_monitor(void) {
       goto clean_and_return;
     }
 
-    if (listInit(&nxpucihal_monitor->sem_list) != 1) {
+    if (semListInit(&nxpucihal_monitor->sem_list) != 1) {
       NXPLOG_UCIHAL_E("Semaphore List creation failed");
       pthread_mutex_destroy(&nxpucihal_monitor->concurrency_mutex);
       pthread_mutex_destroy(&nxpucihal_monitor->reentrance_mutex);
@@ -320,7 +203,7 @@ void phNxpUciHal_cleanup_monitor(void) {
     REENTRANCE_UNLOCK();
     pthread_mutex_destroy(&nxpucihal_monitor->reentrance_mutex);
     phNxpUciHal_releaseall_cb_data();
-    listDestroy(&nxpucihal_monitor->sem_list);
+    semListDestroy(&nxpucihal_monitor->sem_list);
     free(nxpucihal_monitor);
     nxpucihal_monitor = NULL;
   }
@@ -360,9 +243,7 @@ tHAL_UWB_STATUS phNxpUciHal_init_cb_data(phNxpUciHal_Sem_t* pCallbackData,
   pCallbackData->pContext = pContext;
 
   /* Add to active semaphore list */
-  if (listAdd(&phNxpUciHal_get_monitor()->sem_list, pCallbackData) != 1) {
-    NXPLOG_UCIHAL_E("Failed to add the semaphore to the list");
-  }
+  semListAdd(&phNxpUciHal_get_monitor()->sem_list, pCallbackData);
 
   return UWBSTATUS_SUCCESS;
 }
@@ -384,11 +265,7 @@ void phNxpUciHal_cleanup_cb_data(phNxpUciHal_Sem_t* pCallbackData) {
   }
 
   /* Remove from active semaphore list */
-  if (listRemove(&phNxpUciHal_get_monitor()->sem_list, pCallbackData) != 1) {
-    NXPLOG_UCIHAL_E(
-        "phNxpUciHal_cleanup_cb_data: Failed to remove semaphore from the "
-        "list");
-  }
+  semListRemove(&phNxpUciHal_get_monitor()->sem_list, pCallbackData);
 
   return;
 }
@@ -433,17 +310,174 @@ int phNxpUciHal_sem_timed_wait_msec(phNxpUciHal_Sem_t* pCallbackData, long msec)
 **
 *******************************************************************************/
 void phNxpUciHal_releaseall_cb_data(void) {
-  phNxpUciHal_Sem_t* pCallbackData;
+  struct phNxpUciHal_SemList* pList = &phNxpUciHal_get_monitor()->sem_list;
+
+  pthread_mutex_lock(&pList->mutex);
+  while (pList->pFirst != NULL) {
+    phNxpUciHal_Sem_t* pCallbackData = pList->pFirst;
+    pList->pFirst = pCallbackData->pNext;
+    pCallbackData->pPrev = pCallbackData->pNext = NULL;
+    pCallbackData->bRegistered = false;
 
-  while (listGetAndRemoveNext(&phNxpUciHal_get_monitor()->sem_list,
-                              (void**)&pCallbackData)) {
     pCallbackData->status = UWBSTATUS_FAILED;
     sem_post(&pCallbackData->sem);
   }
+  pthread_mutex_unlock(&pList->mutex);
 
   return;
 }
 
+/* Completion pool, kept across monitor init/cleanup so that an object
+ * released after phNxpUciHal_cleanup_monitor() is still valid. */
+#define CB_DATA_POOL_MAX_FREE 8
+
+static pthread_mutex_t cb_data_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static phNxpUciHal_Sem_t* cb_data_pool_free = NULL;
+static size_t cb_data_pool_nr_free = 0;
+
+/*******************************************************************************
+**
+** Function         phNxpUciHal_recycle_cb_data
+**
+** Description      Give an unregistered callback data object back to the pool,
+**                  or free it if the pool is full
+**
+** Returns          None
+**
+*******************************************************************************/
+static void phNxpUciHal_recycle_cb_data(phNxpUciHal_Sem_t* pCallbackData) {
+  /* Drop a post which was not waited for */
+  while (sem_trywait(&pCallbackData->sem) == 0) {
+  }
+
+  pthread_mutex_lock(&cb_data_pool_mutex);
+  if (cb_data_pool_nr_free < CB_DATA_POOL_MAX_FREE) {
+    pCallbackData->pNext = cb_data_pool_free;
+    cb_data_pool_free = pCallbackData;
+    cb_data_pool_nr_free++;
+    pCallbackData = NULL;
+  }
+  pthread_mutex_unlock(&cb_data_pool_mutex);
+
+  if (pCallbackData != NULL) {
+    sem_destroy(&pCallbackData->sem);
+    free(pCallbackData);
+  }
+}
+
+/*******************************************************************************
+**
+** Function         phNxpUciHal_acquire_cb_data
+**
+** Description      Get a callback data object from the pool and register it
+**                  in the monitor, the semaphore is created only when the pool
+**                  is empty.
+**
+** Returns          Callback data, NULL if failed
+**
+*******************************************************************************/
+phNxpUciHal_Sem_t* phNxpUciHal_acquire_cb_data(void* pContext) {
+  phNxpUciHal_Sem_t* pCallbackData;
+
+  pthread_mutex_lock(&cb_data_pool_mutex);
+  pCallbackData = cb_data_pool_free;
+  if (pCallbackData != NULL) {
+    cb_data_pool_free = pCallbackData->pNext;
+    cb_data_pool_nr_free--;
+  }
+  pthread_mutex_unlock(&cb_data_pool_mutex);
+
+  if (pCallbackData == NULL) {
+    pCallbackData = (phNxpUciHal_Sem_t*)malloc(sizeof(phNxpUciHal_Sem_t));
+    if (pCallbackData == NULL) {
+      NXPLOG_UCIHAL_E("Failed to malloc");
+      return NULL;
+    }
+    if (sem_init(&pCallbackData->sem, 0, 0) == -1) {
+      NXPLOG_UCIHAL_E("Semaphore creation failed");
+      free(pCallbackData);
+      return NULL;
+    }
+  }
+
+  pCallbackData->status = UWBSTATUS_FAILED;
+  pCallbackData->pContext = pContext;
+  pCallbackData->bInFlight = false;
+  pCallbackData->bReleased = false;
+  semListAdd(&phNxpUciHal_get_monitor()->sem_list, pCallbackData);
+
+  return pCallbackData;
+}
+
+/*******************************************************************************
+**
+** Function         phNxpUciHal_release_cb_data
+**
+** Description      Unregister a callback data object and give it back to the
+**                  pool, once its TML transaction, if any, has completed
+**
+** Returns          None
+**
+*******************************************************************************/
+void phNxpUciHal_release_cb_data(phNxpUciHal_Sem_t* pCallbackData) {
+  if (pCallbackData == NULL) {
+    return;
+  }
+
+  phNxpUciHal_Monitor_t* pMonitor = phNxpUciHal_get_monitor();
+  if (pMonitor != NULL) {
+    semListRemove(&pMonitor->sem_list, pCallbackData);
+  }
+
+  pthread_mutex_lock(&cb_data_pool_mutex);
+  bool bInFlight = pCallbackData->bInFlight;
+  pCallbackData->bReleased = bInFlight;
+  pthread_mutex_unlock(&cb_data_pool_mutex);
+
+  if (!bInFlight) {
+    phNxpUciHal_recycle_cb_data(pCallbackData);
+  }
+}
+
+/*******************************************************************************
+**
+** Function         phNxpUciHal_hold_cb_data
+**
+** Description      Mark a pooled callback data object as referenced by a TML
+**                  transaction, before the transaction is submitted
+**
+** Returns          None
+**
+*******************************************************************************/
+void phNxpUciHal_hold_cb_data(phNxpUciHal_Sem_t* pCallbackData) {
+  pthread_mutex_lock(&cb_data_pool_mutex);
+  pCallbackData->bInFlight = true;
+  pthread_mutex_unlock(&cb_data_pool_mutex);
+}
+
+/*******************************************************************************
+**
+** Function         phNxpUciHal_unhold_cb_data
+**
+** Description      The TML transaction has completed, been flushed or was not
+**                  submitted. Recycles the object if it was released already,
+**                  it must not be used by the caller afterwards.
+**
+** Returns          None
+**
+*******************************************************************************/
+void phNxpUciHal_unhold_cb_data(phNxpUciHal_Sem_t* pCallbackData) {
+  pthread_mutex_lock(&cb_data_pool_mutex);
+  bool bReleased = pCallbackData->bReleased;
+  pCallbackData->bInFlight = false;
+  pCallbackData->bReleased = false;
+  pthread_mutex_unlock(&cb_data_pool_mutex);
+
+  if (bReleased) {
+    phNxpUciHal_recycle_cb_data(pCallbackData);
+  }
+}
+
 /* END Semaphore and mutex helper functions */
 
 /**************************** Other functions *********************************/
@@ -33,17 +33,6 @@
 
 /********************* Definitions and structures *****************************/
 
-/* List structures */
-struct listNode {
-  void* pData;
-  struct listNode* pNext;
-};
-
-struct listHead {
-  struct listNode* pFirst;
-  pthread_mutex_t mutex;
-};
-
 /* Which is the direction of UWB Packet.
  *
  * Used by the @ref phNxpUciHal_print_packet API.
@@ -67,8 +56,24 @@ typedef struct phNxpUciHal_Sem {
   /* Used to provide a local context to the callback */
   void* pContext;
 
+  /* Links in the monitor's semaphore list, valid while bRegistered is set */
+  struct phNxpUciHal_Sem* pPrev;
+  struct phNxpUciHal_Sem* pNext;
+  bool bRegistered;
+
+  /* Pooled callback data referenced by a pending TML transaction, and
+   * released by its owner meanwhile. Under the pool mutex. */
+  bool bInFlight;
+  bool bReleased;
+
 } phNxpUciHal_Sem_t;
 
+/* Intrusive doubly linked list of semaphores */
+struct phNxpUciHal_SemList {
+  phNxpUciHal_Sem_t* pFirst;
+  pthread_mutex_t mutex;
+};
+
 /* Semaphore helper macros */
 static inline int SEM_WAIT(phNxpUciHal_Sem_t* pCallbackData)
 {
@@ -89,19 +94,11 @@ typedef struct phNxpUciHal_Monitor {
   pthread_mutex_t concurrency_mutex;
 
   /* List used to track pending semaphores waiting for callback */
-  struct listHead sem_list;
+  struct phNxpUciHal_SemList sem_list;
 
 } phNxpUciHal_Monitor_t;
 
 /************************ Exposed functions ***********************************/
-/* List functions */
-int listInit(struct listHead* pList);
-int listDestroy(struct listHead* pList);
-int listAdd(struct listHead* pList, void* pData);
-int listRemove(struct listHead* pList, void* pData);
-int listGetAndRemoveNext(struct listHead* pList, void** ppData);
-void listDump(struct listHead* pList);
-
 /* NXP UCI HAL utility functions */
 phNxpUciHal_Monitor_t* phNxpUciHal_init_monitor(void);
 void phNxpUciHal_cleanup_monitor(void);
@@ -125,6 +122,16 @@ static inline int phNxpUciHal_sem_timed_wait(phNxpUciHal_Sem_t* pCallbackData)
 void phNxpUciHal_cleanup_cb_data(phNxpUciHal_Sem_t* pCallbackData);
 void phNxpUciHal_releaseall_cb_data(void);
 
+/* Pooled callback data, same contract as init/cleanup_cb_data() without
+ * creating a semaphore for every transaction. */
+phNxpUciHal_Sem_t* phNxpUciHal_acquire_cb_data(void* pContext);
+void phNxpUciHal_release_cb_data(phNxpUciHal_Sem_t* pCallbackData);
+/* Pooled callback data passed to a TML transaction is held until the
+ * transaction completes, even if its owner was woken up before by
+ * phNxpUciHal_releaseall_cb_data() and released it. */
+void phNxpUciHal_hold_cb_data(phNxpUciHal_Sem_t* pCallbackData);
+void phNxpUciHal_unhold_cb_data(phNxpUciHal_Sem_t* pCallbackData);
+
 // helper class for Semaphore
 // phNxpUciHal_init_cb_data(), phNxpUciHal_cleanup_cb_data(),
 // SEM_WAIT(), SEM_POST()